@@ -3,18 +3,60 @@
 
 #include <QtTypes>
 #include <QDebug>
+#include <QImage>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QDeadlineTimer>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QMultiHash>
+#include <QList>
+#include <QFile>
+#include <list>
+#include <functional>
 
 namespace gia_tga_qt
 {
 enum class GIA_TgaErr: size_t { InvalidHeader = 0, ValidHeader = 1, TruncDataAbort = 2, TooMuchPixAbort      = 3,
                                 Success       = 4, MemAllocErr = 5, NotInitialized = 6, NeedHeaderValidation = 7,
-                                NeedDecoding  = 8 };
+                                NeedDecoding  = 8, NoPostageStamp = 9, SmallBuffer = 10, InvalidRegion = 11,
+                                Cancelled     = 12, BudgetExceeded = 13, FileIOErr = 14, InvalidIndex = 15 };
 
 enum class GIA_TgaOrigin: quint8 {  TopLeft    = 0b00100000,    TopRight = 0b00110000,
                                     BottomLeft = 0b00000000, BottomRight = 0b00010000,
                                     Unknown    = 0b11111111 // значение при невалидированном заголовке
                                 };
 
+enum class GIA_TgaMipFilter: quint8 {   None    = 0, // цепочка мип-уровней не строится
+                                        Box     = 1, // усреднение 2x2 непосредственно по значениям каналов
+                                        BoxSRGB = 2  // усреднение 2x2 в линейном свете (корректно для sRGB-текстур)
+                                    };
+
+enum class GIA_TgaLayout: quint8 { Linear = 0, // сканлинии подряд
+                                    Tiled  = 1, // квадратные плитки подряд, внутри плитки - сканлинии
+                                    Morton = 2  // квадратные плитки подряд, внутри плитки - Z-порядок (Morton)
+                                    };
+
+enum class GIA_TgaBcFormat: quint8 { BC1 = 1, // 8 байтов на блок 4x4 : цвет 5:6:5 и однобитная альфа
+                                      BC3 = 3  // 16 байтов на блок 4x4 : цвет как у BC1 и интерполированная альфа
+                                      };
+
+enum class GIA_TgaFloatFormat: quint8 {   None    = 0, // выдача BB GG RR AA по байту на канал
+                                          RGBA32F = 1, // R G B A по float на канал (16 байтов на пиксель)
+                                          RGBA16F = 2  // R G B A по half (IEEE 754 binary16) на канал (8 байтов на пиксель)
+                                          };
+
+enum class GIA_TgaKeyColor: quint8 {   None     = 0, // цветовой ключ не применяется
+                                       FromFile = 1, // key_color из области расширений TGA 2.0 (без области ключ не применяется)
+                                       Custom   = 2  // цвет, переданный в set_key_color
+                                       };
+
+enum class GIA_TgaAlphaKind: quint8 {   Unknown     = 0, // изображение ещё не декодировано
+                                        Opaque      = 1, // вся альфа равна 255
+                                        Binary      = 2, // альфа принимает только значения 0 и 255
+                                        Translucent = 3  // есть промежуточные значения, нужно смешивание
+                                    };
+
 #pragma pack(push,1)
 struct GIA_TgaHeader
 {
@@ -31,6 +73,37 @@ struct GIA_TgaHeader
     quint8  pix_depth;
     quint8  img_descr;
 };
+struct GIA_TgaPackHeader // заголовок файла пака .tgapak (все поля little-endian)
+{
+    char     magic[8]; // "GIATPAK\0"
+    quint32 version; // 1
+    quint32 entry_count;
+    quint64 index_offset; // смещение индекса : entry_count записей GIA_TgaPackEntry, за ними - таблица имён
+    quint64 names_size; // размер таблицы имён в байтах
+};
+struct GIA_TgaPackEntry // запись индекса пака : место объекта и готовые итоги validate_header
+{
+    quint64 offset; // смещение объекта от начала пака
+    quint64 size; // размер объекта в байтах
+    quint32 name_offset; // смещение имени в таблице имён (UTF-8, без завершающего нуля)
+    quint32 name_len;
+    quint32 pix_data_offset; // смещение пиксельных данных внутри объекта
+    GIA_TgaHeader header; // копия проверенного заголовка : размеры, тип, origin, палитра
+    quint8  reserved[2];
+};
+struct GIA_TgaRleIndexHeader // заголовок индекса rle-пакетов (build_rle_index), за ним entry_count записей GIA_TgaRleIndexEntry
+{
+    char     magic[8]; // "GIATRI1\0"
+    GIA_TgaHeader header; // копия заголовка объекта, для которого построен индекс
+    quint64 pix_data_size; // размер пиксельных данных объекта (от pix_data_offset до конца)
+    quint32 rows_step; // шаг индекса в сканлиниях
+    quint32 entry_count;
+};
+struct GIA_TgaRleIndexEntry // место начала сканлинии entry_idx * rows_step (в порядке файла)
+{
+    quint64 src_idx; // смещение заголовка пакета, в котором начинается сканлиния, от начала пиксельных данных
+    quint8  packet_done; // сколько пикселей этого пакета относится к предыдущим сканлиниям
+};
 struct GIA_TgaExtInfo
 {
     QString author;
@@ -72,6 +145,65 @@ struct GIA_TgaInfo
 };
 #pragma pack(pop)
 
+struct GIA_TgaStamp
+{
+    int width;
+    int height;
+    qsizetype bytes_per_line;
+    QByteArray data; // пиксели в формате BB GG RR AA, уже приведённые к TopLeft
+};
+
+struct GIA_TgaMipLevel
+{
+    int width;
+    int height;
+    qint64 bytes_per_line; // размер сканлинии уровня в байтах
+    qint64 offset; // смещение уровня от начала массива data()
+};
+
+struct GIA_TgaAlpha
+{
+    GIA_TgaAlphaKind kind;
+    quint8 min; // минимальная альфа
+    quint8 max; // максимальная альфа
+};
+
+struct GIA_TgaStats // статистика выдаваемых пикселей, собранная ядрами decode (set_stats)
+{
+    qint64 pixels; // учтённых пикселей (у прерванного декодирования - только раскодированные)
+    quint64 histogram[4][256]; // гистограммы каналов BB, GG, RR, AA
+    quint8 min[4]; // минимальные значения каналов BB, GG, RR, AA
+    quint8 max[4]; // максимальные значения каналов
+    double mean[4]; // средние значения каналов
+};
+
+struct GIA_TgaTileInfo
+{
+    GIA_TgaLayout layout;
+    int tile_size; // сторона плитки в пикселях (0 у Linear)
+    int tiles_x; // плиток по горизонтали
+    int tiles_y; // плиток по вертикали
+    qint64 tile_bytes; // размер плитки в байтах; плитки идут подряд рядами слева направо, сверху вниз
+    qint64 total_size; // размер массива данных вместе с полями краевых плиток
+};
+
+struct GIA_TgaShmImage
+{
+    int fd; // дескриптор memfd (или объекта shm_open, уже удалённого из пространства имён); -1 - нет
+    qint64 size; // размер объекта в байтах
+    int width;
+    int height;
+    qint64 bytes_per_line; // размер сканлинии в байтах (у плиток - ширина изображения * 4)
+    GIA_TgaLayout layout;
+    int tile_size; // сторона плитки при Tiled/Morton (0 у Linear)
+    GIA_TgaFloatFormat float_format; // None - BB GG RR AA, иначе R G B A во float/half
+    bool premultiplied; // каналы цвета умножены на альфу
+    bool sealed; // установлены F_SEAL_WRITE, F_SEAL_SHRINK, F_SEAL_GROW и F_SEAL_SEAL : содержимое больше не меняется
+};
+
+using GIA_TgaProgress = std::function<bool(int rows_done, int rows_total)>; // возврат false отменяет декодирование
+using GIA_TgaRowSink = std::function<bool(int first_row, int row_count, const uchar *pixels, qsizetype bytes_per_line)>; // полоса сканлиний в нормальной ориентации; возврат false отменяет декодирование
+
 class GIA_TgaDecoder
 {
 #pragma pack(push,1)
@@ -123,6 +255,14 @@ class GIA_TgaDecoder
         quint8  attr_type;
     };
 #pragma pack(pop)
+    struct row_reader // состояние последовательного чтения исходных пикселей, в том числе сквозь границы rle-пакетов
+    {
+        qint64 src_idx; // byte index in pixel data
+        qint64 src_end; // pixel data size (from pix_data_offset to the end of source file)
+        qint64 packet_left; // сколько пикселей текущего пакета ещё не прочитано
+        bool is_rle_packet; // текущий пакет - rle-группа
+        quint32 rle_value; // раскодированный пиксель rle-группы
+    };
 private:
     enum class FSM_States: size_t { NotInitialized, Initialized, HeaderValidated, InvalidHeader, DecodedOK, DecodingAbort, NotEnoughMem };
     static const QStringList err_strings;
@@ -132,11 +272,19 @@ private:
     quint8 *src_array;
     size_t src_size;
     GIA_TgaHeader *header;
+    GIA_TgaHeader header_copy; // заголовок из индекса пака (init с записью GIA_TgaPackEntry)
     qint64 pix_data_offset;
     quint8 *dst_array; // указатель не раскодированные данные
     qint64 total_size_p; // полный ожидаемый размер раскодированных данных в пикселях
     qint64 total_size_b; // полный ожидаемый размер раскодированных данных в байтах
     bool is_data_detached;
+    quint8 *ext_dst_array; // буфер вызывающего для следующего декодирования (set_dst_buffer)
+    qint64 ext_dst_size; // размер буфера вызывающего в байтах
+    bool is_dst_external; // dst_array - буфер вызывающего (не освобождается, но flip с ним работает)
+    quint8 *own_array; // собственный массив объекта : dst_array указывает на него, если данные не внешние и не отсоединены
+    qint64 own_capacity; // размер own_array в байтах
+    qint64 own_used; // байтов own_array занято текущим изображением (0 - изображения нет)
+    bool reuse_dst; // init и decode оставляют own_array для следующего изображения (set_dst_reuse)
     quint16 width;
     quint16 height;
     qsizetype bytes_per_line;
@@ -146,11 +294,66 @@ private:
     quint8 cmap_elem_depth; // размер элемента палитры в битах
     quint8 cmap_elem_size; // размер элемента палитры в байтах
     quint16 cmap_len; // количество элементов в палитре (от 1 до 256)
+    quint16 cmap_first; // индекс первого элемента палитры (cmap_start из заголовка)
     quint8 alpha_bits; // количество бит альфа-канала
     qint8 image_type;
     FSM_States state;
     bbggrraa *color_map;
     qint64 cmap_offset;
+    GIA_TgaMipFilter mip_filter; // фильтр цепочки мип-уровней (None - цепочка не строится)
+    bool use_color_correction; // применять таблицу цветовой коррекции и гамму из области расширений TGA 2.0
+    bool pp_active; // включена хотя бы одна попиксельная обработка (выполняется внутри ядер декодирования)
+    bool luts_active; // таблицы каналов channel_lut не тождественные
+    quint8 channel_lut[4][256]; // таблицы перевода каналов BB, GG, RR, AA
+    bool premultiply; // выдавать каналы цвета, умноженные на альфу
+    GIA_TgaKeyColor key_mode; // источник цветового ключа
+    quint32 key_custom; // цвет ключа вызывающего (GIA_TgaKeyColor::Custom)
+    bool key_active; // цветовой ключ применяется в текущем декодировании
+    quint32 key_rgb; // байты цвета ключа 0x00RRGGBB текущего декодирования
+    GIA_TgaFloatFormat float_format; // формат выдачи decode и decode_rows
+    bool float_linear; // при переводе во float цвет переводится из sRGB в линейный свет
+    bool pm_float; // умножение на альфу выполняется при переводе во float (в линейном свете), а не над байтами
+    bool square_pixels; // decode и decode_rows выдают квадратные пиксели (set_square_pixels)
+    bool aspect_active; // текущее декодирование передискретизирует сканлинии по pix_numer/pix_denom
+    int aspect_width; // ширина сканлинии после передискретизации
+    int aspect_taps; // весов на выходной пиксель (чётное : SSE2 берёт исходные пиксели парами)
+    QList<qint32> aspect_start; // первый исходный пиксель окна каждого выходного пикселя
+    QList<qint16> aspect_weights; // веса окон в фиксированной точке 2.14 (сумма окна - 16384)
+    bool pm_active; // умножение на альфу требуется (альфа не является заведомо непрозрачной)
+    bool alpha_collect; // текущее декодирование собирает сведения об альфе (миниатюра их не трогает)
+    bool alpha_scan; // сведения об альфе собираются ядрами по пикселям (иначе ответ известен по заголовку или палитре)
+    quint8 alpha_lo; // минимальная встреченная альфа
+    quint8 alpha_hi; // максимальная встреченная альфа
+    bool alpha_partial; // встречались значения альфы, отличные от 0 и 255
+    bool stats_enabled; // decode собирает статистику пикселей (set_stats)
+    bool stats_scan; // текущее декодирование собирает статистику
+    bool stats_collected; // статистика последнего декодирования собрана
+    quint32 stats_hist[2][4][256]; // гистограммы каналов, накопленные ядрами : чётные и нечётные пиксели порознь (32 бита хватает на 65535 x 65535)
+    quint64 stats_index[256]; // счётчики индексов палитровых изображений (цвета добавляются в stats по палитре)
+    quint32 stats_palette[256]; // обработанная палитра для stats_index
+    qint16 stats_alpha; // альфа, заведомо одинаковая у всех пикселей (её гистограмма не ведётся по пикселям), -1 - альфа сканируется
+    GIA_TgaProgress progress_cb; // обратный вызов прогресса по полосам сканлиний
+    int ctl_band_rows; // высота полосы сканлиний между вызовами progress_cb
+    qint64 ctl_band_pix; // размер полосы в исходных пикселях
+    qint64 ctl_next_band; // число исходных пикселей, после которого вызывается progress_cb
+    qint64 ctl_next_pix; // число исходных пикселей, после которого ядро вызывает band_done (INT64_MAX - контроль выключен)
+    qint64 ctl_total_pix; // исходных пикселей всего
+    bool ctl_each_row; // отмена и бюджеты проверяются на каждой сканлинии
+    GIA_TgaErr ctl_stop; // причина прерывания : Cancelled, BudgetExceeded (Success - декодирование не прерывалось)
+    qint64 pixel_budget; // предельное число исходных пикселей за одно декодирование (0 - без предела)
+    qint64 time_budget; // предельное время одного декодирования в миллисекундах (0 - без предела)
+    QDeadlineTimer ctl_deadline; // момент исчерпания time_budget текущего декодирования
+    const QAtomicInt *cancel_token; // внешний флаг отмены (не 0 - прервать)
+    quint16 ctl_width; // исходные размеры изображения для отчёта о прогрессе
+    quint16 ctl_height;
+    QList<GIA_TgaMipLevel> mip_chain; // уровни цепочки, нулевой - само изображение
+    GIA_TgaLayout layout; // раскладка пикселей, которую выдаёт decode
+    int tile_shift; // log2 стороны плитки
+    bool is_dst_tiled; // dst_array разложен по плиткам (уже в ориентации TopLeft, flip не нужен)
+    bool is_dst_compressed; // dst_array содержит блоки BC1/BC3 (уже в ориентации TopLeft, flip не нужен)
+    bool is_dst_converted; // dst_array собран decode_converted : float/half и/или квадратные пиксели (уже в ориентации TopLeft, flip не нужен)
+    QList<GIA_TgaRleIndexEntry> rle_index; // индекс rle-пакетов (build_rle_index, load_rle_index), пуст - индекса нет
+    int rle_index_step; // шаг индекса в сканлиниях
     QString id_string;
 private:
     GIA_TgaErr create_cmap_256();
@@ -166,12 +369,42 @@ private:
     GIA_TgaErr decode_tc_rle16();
     GIA_TgaErr decode_tc_rle24();
     GIA_TgaErr decode_tc_rle32();
+    GIA_TgaErr decode_tiled(); // decode с раскладкой по плиткам
+    GIA_TgaErr decode_converted(); // decode с переводом каждой сканлинии : квадратные пиксели и/или float/half
+    qint64 float_pix_size(); // размер выдаваемого пикселя в байтах (4 без перевода во float)
+    qint64 decode_size(); // размер массива, который выдаст decode при текущих настройках
+    void convert_row_float(const quint32 *src, quint8 *dst, qint64 count); // BB GG RR AA -> R G B A float/half по таблицам из 256 элементов
+    bool prepare_aspect(); // готовит веса передискретизации до квадратных пикселей; false - она не нужна
+    void resample_row(const quint32 *src, quint32 *dst); // горизонтальная передискретизация сканлинии по готовым весам
+    void convert_row(quint32 *row, quint32 *aspect_row, quint8 *dst); // передискретизация и/или перевод во float раскодированной сканлинии
+    static quint32 spread_bits(quint32 value); // 0b abcd -> 0b 0a0b0c0d, половина кода Morton
+    static void encode_bc_block(const quint32 *block, GIA_TgaBcFormat format, quint8 *dst); // сжатие блока 4x4 в BC1/BC3
+    static void encode_bc3_alpha(const quint32 *block, quint8 min_alpha, quint8 max_alpha, quint8 *dst); // альфа-блок BC3
     void fill_with_dword(quint32 value, void *dst_start, quint8 count);
     void fill_with_zeroes();
+    extensions_area* find_ext_area(); // область расширений TGA 2.0 или nullptr
+    void reader_start(row_reader &reader); // установка на начало пиксельных данных
+    GIA_TgaErr reader_seek(row_reader &reader, qint64 scln, qint64 scln_width); // установка на начало сканлинии scln (в порядке файла) с помощью индекса rle-пакетов
+    void convert_pixels(const quint8 *src, quint32 *dst, qint64 count); // перевод count исходных пикселей в формат 0xAARRGGBB
+    GIA_TgaErr read_pixels(row_reader &reader, quint32 *dst, qint64 count); // читает очередные count пикселей в dst (при dst == nullptr пропускает их)
+    bool is_alpha_opaque(); // альфа исходных пикселей заведомо равна 0xFF (определяется по заголовку, без сканирования)
+    void prepare_pixel_ops(bool collect_alpha, bool float_out = false, bool collect_stats = false); // готовит попиксельные обработки перед декодированием
+    GIA_TgaErr alloc_dst(qint64 alloc_size); // выделяет dst_array (или переиспользует own_array) либо берёт под него буфер вызывающего
+    void release_dst(); // отпускает dst_array : собственный массив освобождается либо остаётся для следующего изображения
+    void reset_dims(); // восстанавливает размеры изображения из заголовка
+    bool band_done(qint64 pix_done); // граница сканлинии/полосы : прогресс, отмена, бюджеты; false - прервать с кодом ctl_stop
+    void scan_alpha(const quint32 *pixels, qint64 count); // накапливает min/max альфы и признак промежуточных значений
+    void premultiply_pixels(quint32 *pixels, qint64 count); // умножение каналов цвета на альфу с точным делением на 255
+    void mask_key_color(quint32 *pixels, qint64 count); // пиксели цвета key_rgb заменяются прозрачным чёрным
+    void add_stats(const quint32 *pixels, qint64 count, quint64 weight); // добавляет пиксели в гистограммы, каждый weight раз
+    void process_pixels(quint32 *pixels, qint64 count, quint64 weight = 1); // попиксельные обработки, вызываются ядрами по ещё горячим данным; weight - вес пикселя в статистике
+    qint64 mip_chain_size(); // размер всех мип-уровней кроме нулевого в байтах
+    void build_mipmaps(); // строит мип-уровни в dst_array сразу за изображением
+    void reduce_level(const GIA_TgaMipLevel &src_lvl, const GIA_TgaMipLevel &dst_lvl, bool skip_first_col, bool skip_first_row);
     void dump_to_file(); // для отладки, приватный метод
-    void flip_dia(); // переворачивает BottomRight к TopLeft (diagonal flip)
-    void flip_ver(); // переворачивает BottomLeft к TopLeft (vertical flip)
-    void flip_hor(); // переворачивает TopRight к TopLeft (horizontal flip)
+    void flip_dia(quint32 *array, qint64 pix_count); // переворачивает BottomRight к TopLeft (diagonal flip)
+    void flip_ver(quint32 *array, qint64 flip_width, qint64 flip_height); // переворачивает BottomLeft к TopLeft (vertical flip)
+    void flip_hor(quint32 *array, qint64 flip_width, qint64 flip_height); // переворачивает TopRight к TopLeft (horizontal flip)
 public:
     GIA_TgaDecoder();
     GIA_TgaDecoder(const GIA_TgaDecoder&) = delete;
@@ -179,13 +412,209 @@ public:
     ~GIA_TgaDecoder();
 
     void init(uchar *object_ptr, size_t object_size); // обязательная начальная инициализация
-    GIA_TgaErr validate_header(int max_width = 8192, int max_height = 16384); // проверяет заголовок объекта на корректность
+    GIA_TgaErr init(uchar *object_ptr, size_t object_size, const GIA_TgaPackEntry &entry); // инициализация с заголовком из индекса пака вместо validate_header
+    GIA_TgaErr validate_header(int max_width = 65535, int max_height = 65535); // проверяет заголовок объекта на корректность
     GIA_TgaErr decode(); // выделяет память и декодирует в неё объект
+    GIA_TgaErr decode_scaled(quint8 factor); // декодирует с уменьшением в factor раз по каждой стороне без полноразмерного буфера
+    QFuture<GIA_TgaErr> decode_async(); // decode через QtConcurrent; прогресс и cancel() идут через QFuture
+    GIA_TgaErr decode_region(int x, int y, int region_width, int region_height); // декодирует только прямоугольную область изображения
+    GIA_TgaErr decode_rows(GIA_TgaRowSink sink, int band_rows = 64); // потоковое декодирование полосами сканлиний без полноразмерного буфера
+    GIA_TgaErr decode_to_file(const QString &path, int band_rows = 64); // потоковое декодирование в файл сырых пикселей BB GG RR AA (TopLeft)
+    GIA_TgaErr decode_to_shm(GIA_TgaShmImage &image, bool seal = true); // decode в memfd/shm для передачи другому процессу без копирования
+    GIA_TgaErr recompress_rle(QByteArray &result); // перепаковывает объект без потерь в оптимальный rle-тип 9/10/11
+    GIA_TgaErr build_rle_index(QByteArray &index, int rows_step = 16); // строит индекс rle-пакетов для decode_region и выдаёт его для сохранения
+    GIA_TgaErr load_rle_index(const QByteArray &index); // подключает сохранённый индекс rle-пакетов
+    void set_dst_buffer(quint8 *buffer, qint64 buffer_size); // следующее декодирование пишет в буфер вызывающего вместо dst_array
+    void set_dst_reuse(bool enable); // init и decode сохраняют собственный массив и переиспользуют его, если новое изображение помещается
+    GIA_TgaErr reserve(qint64 new_capacity); // заранее выделяет собственный массив не меньше new_capacity байтов
+    void shrink_to_fit(); // уменьшает собственный массив до размера текущего изображения (без изображения - освобождает)
+    qint64 capacity(); // размер собственного массива в байтах
+    void set_progress(GIA_TgaProgress callback, int band_rows = 64); // прогресс по полосам из band_rows сканлиний и возможность отмены
+    void set_cancel_token(const QAtomicInt *token); // внешний флаг отмены, проверяется на каждой сканлинии (nullptr - без флага)
+    void set_budget(qint64 time_limit_ms, qint64 pixel_limit = 0); // пределы времени (мс) и пикселей на одно декодирование (0 - без предела)
     const QString& err_str(GIA_TgaErr err_code); // возвращает строковую расшифровку ошибки
     GIA_TgaErr detach_data(); // отсоединяет от себя указатель на dst_array
     uchar* data(); // возвращает указатель на dst_array
     GIA_TgaInfo info(); // возвращает свойства tga-объекта
+    GIA_TgaErr decode_postage_stamp(GIA_TgaStamp &stamp); // декодирует встроенную миниатюру (postage stamp) без обращения к основным пиксельным данным
     void flip(); // переворачивает изображение к нормальному, если origin отличается от TopLeft
+    void set_mipmaps(GIA_TgaMipFilter filter); // включает построение цепочки мип-уровней при decode
+    GIA_TgaErr decode_bc(GIA_TgaBcFormat format); // транскодирование в блоки BC1/BC3 полосами по 4 сканлинии, без полноразмерного буфера
+    qint64 bc_size(GIA_TgaBcFormat format); // размер массива блоков BC1/BC3 в байтах
+    void set_layout(GIA_TgaLayout new_layout, int tile_size = 64); // раскладка пикселей decode : сканлинии, плитки или плитки с Z-порядком
+    GIA_TgaTileInfo tile_info(); // геометрия плиток для текущих размеров и раскладки
+    uchar* tile(int tile_x, int tile_y); // указатель на плитку внутри data() (nullptr вне диапазона или без плиток)
+    qint64 pixel_offset(int x, int y); // смещение пикселя нормально ориентированного изображения от начала data() в байтах
+    void set_color_correction(bool enable); // включает применение таблицы цветовой коррекции и гаммы TGA 2.0 при декодировании
+    void set_premultiplied(bool enable); // включает выдачу пикселей с каналами цвета, умноженными на альфу
+    void set_key_color(GIA_TgaKeyColor mode, quint32 color = 0); // пиксели цвета ключа (0xRRGGBB, альфа не сравнивается) становятся прозрачными
+    void set_float_output(GIA_TgaFloatFormat format, bool linear = true); // decode и decode_rows выдают R G B A во float/half, linear - перевод цвета из sRGB в линейный свет
+    void set_square_pixels(bool enable); // decode и decode_rows растягивают/сжимают сканлинии до квадратных пикселей по pix_numer/pix_denom
+    QImage::Format qimage_format(); // формат QImage для массива data() : Format_ARGB32, Format_RGBA32FPx4, Format_RGBA16FPx4 или их Premultiplied-варианты
+    const QList<GIA_TgaMipLevel>& mip_levels(); // уровни цепочки с их смещениями внутри data()
+    GIA_TgaAlpha alpha_info(); // классификация альфа-канала, собранная во время decode/decode_scaled
+    void set_stats(bool enable); // decode собирает гистограммы, min/max и средние каналов внутри ядер декодирования
+    GIA_TgaStats stats(); // статистика последнего decode (pixels == 0 - не собиралась)
+};
+
+struct GIA_TgaImage // декодированное изображение, которое кэш раздаёт потребителям; не меняется после создания
+{
+    int width;
+    int height;
+    qsizetype bytes_per_line;
+    GIA_TgaErr result; // итог decode : Success, TruncDataAbort или TooMuchPixAbort
+    QByteArray data; // пиксели в формате BB GG RR AA, уже приведённые к TopLeft
+};
+
+// кэш декодированных изображений по хешу содержимого исходного объекта; потокобезопасен
+class GIA_TgaCache
+{
+    struct cache_entry
+    {
+        quint64 hash; // хеш исходного объекта
+        quint64 check; // второй хеш с другим зерном : одного совпадения hash для попадания мало
+        qint64 src_size; // размер исходного объекта
+        QSharedPointer<const GIA_TgaImage> image;
+    };
+    struct cache_shard // шард со своей блокировкой, списком LRU и индексом
+    {
+        QMutex lock;
+        std::list<cache_entry> lru; // в начале - недавно использованные
+        QMultiHash<quint64, std::list<cache_entry>::iterator> index;
+        qint64 used_bytes = 0;
+    };
+    QList<QSharedPointer<cache_shard>> shards;
+    qint64 shard_budget; // бюджет одного шарда в байтах
+    static const quint64 check_seed = 0x27D4EB2F165667C5; // зерно второго хеша
+    static qint64 entry_bytes(const GIA_TgaImage &image); // сколько байтов бюджета занимает изображение
+public:
+    explicit GIA_TgaCache(qint64 budget_bytes, int shard_count = 16);
+    GIA_TgaCache(const GIA_TgaCache&) = delete;
+    GIA_TgaCache& operator=(const GIA_TgaCache&) = delete;
+
+    QSharedPointer<const GIA_TgaImage> get(uchar *object_ptr, size_t object_size, GIA_TgaErr *err = nullptr); // находит изображение в кэше либо декодирует и кладёт в кэш
+    void clear(); // удаляет все изображения (уже выданные остаются жить у потребителей)
+    qint64 used_bytes(); // занятый объём по всем шардам
+    static QSharedPointer<const GIA_TgaImage> decode_image(uchar *object_ptr, size_t object_size, GIA_TgaErr *err = nullptr); // декодирует объект в изображение без участия кэша (как при промахе)
+    static quint64 content_hash(const quint8 *data, qint64 size, quint64 seed = 0); // 64-битный хеш содержимого (алгоритм XXH64)
+};
+
+using GIA_TgaLoadDone = std::function<void(qsizetype file_idx, GIA_TgaErr result, QSharedPointer<const GIA_TgaImage> image)>; // итог по одному файлу; вызывается из рабочих потоков, одновременно для разных файлов
+
+// пакетная загрузка множества файлов : чтение через io_uring (Linux) либо пулом потоков с pread, декодирование по мере прихода байтов
+class GIA_TgaBulkLoader
+{
+    struct load_job // прочитанный файл, ожидающий декодирования
+    {
+        qsizetype file_idx;
+        GIA_TgaErr read_result; // Success или FileIOErr
+        QByteArray bytes;
+    };
+    int thread_count; // потоки декодирования (в запасном режиме они же читают файлы)
+    int queue_depth; // сколько чтений одновременно стоит в очереди io_uring
+    bool uring_enabled = true;
+    bool uring_used = false;
+    GIA_TgaCache *cache; // если задан, изображения берутся через кэш
+
+    void finish_job(load_job &job, const GIA_TgaLoadDone &done); // декодирует прочитанный файл и сообщает итог
+    bool load_uring(const QStringList &paths, const GIA_TgaLoadDone &done); // false - io_uring недоступен, ни один файл не тронут
+    void load_pread(const QStringList &paths, const GIA_TgaLoadDone &done);
+    static GIA_TgaErr read_file(const QString &path, QByteArray &bytes);
+public:
+    explicit GIA_TgaBulkLoader(int threads = 0, int depth = 64, GIA_TgaCache *image_cache = nullptr); // threads = 0 - по числу ядер
+    GIA_TgaBulkLoader(const GIA_TgaBulkLoader&) = delete;
+    GIA_TgaBulkLoader& operator=(const GIA_TgaBulkLoader&) = delete;
+
+    void load(const QStringList &paths, GIA_TgaLoadDone done); // возвращается, когда done вызван для каждого файла
+    void set_io_uring(bool enable); // false - всегда пул потоков с pread
+    bool io_uring_used(); // шла ли последняя загрузка через io_uring
+};
+
+// построитель пака .tgapak : объекты дописываются в файл по мере добавления, индекс с готовыми заголовками - в finish
+class GIA_TgaPackBuilder
+{
+    QFile pack_file;
+    QList<GIA_TgaPackEntry> entries;
+    QList<QByteArray> names; // имена в UTF-8
+    quint64 write_pos = 0; // текущий конец файла пака
+    bool is_open = false;
+public:
+    GIA_TgaPackBuilder() = default;
+    GIA_TgaPackBuilder(const GIA_TgaPackBuilder&) = delete;
+    GIA_TgaPackBuilder& operator=(const GIA_TgaPackBuilder&) = delete;
+
+    GIA_TgaErr begin(const QString &pack_path); // создаёт файл пака
+    GIA_TgaErr add(const QString &name, uchar *object_ptr, size_t object_size); // проверяет заголовок объекта и дописывает объект в пак
+    GIA_TgaErr add_file(const QString &path, const QString &name = QString()); // читает файл и добавляет под именем name (по умолчанию - path)
+    GIA_TgaErr finish(); // дописывает индекс, отсортированный по именам, и закрывает файл
+    qsizetype count(); // сколько объектов добавлено
+};
+
+// пак .tgapak для чтения : весь файл отображается в память одним QFile::map, объекты декодируются без открытия файлов и разбора заголовков
+class GIA_TgaPack
+{
+    QFile pack_file;
+    uchar *pack_ptr = nullptr;
+    qint64 pack_size = 0;
+    bool is_mapped = false; // false - пак прочитан в pack_bytes (отображение не удалось)
+    QByteArray pack_bytes;
+    const GIA_TgaPackEntry *index = nullptr;
+    qsizetype entry_count = 0;
+    const char *names = nullptr; // таблица имён
+public:
+    GIA_TgaPack() = default;
+    ~GIA_TgaPack();
+    GIA_TgaPack(const GIA_TgaPack&) = delete;
+    GIA_TgaPack& operator=(const GIA_TgaPack&) = delete;
+
+    GIA_TgaErr open(const QString &pack_path); // отображает пак и проверяет индекс
+    void close();
+    qsizetype count(); // количество объектов в паке
+    qsizetype find(const QString &name); // номер записи по имени (двоичный поиск) либо -1
+    QString name(qsizetype entry_idx); // имя записи
+    const GIA_TgaPackEntry* entry(qsizetype entry_idx); // запись индекса (nullptr вне диапазона)
+    uchar* object(qsizetype entry_idx); // начало объекта внутри отображения (nullptr вне диапазона)
+    GIA_TgaErr init_decoder(GIA_TgaDecoder &decoder, qsizetype entry_idx); // init декодера объектом записи с готовым заголовком
+};
+
+struct GIA_TgaDiskCacheHeader // заголовок файла дискового кэша; за ним сразу пиксели BB GG RR AA (все поля little-endian)
+{
+    char     magic[8]; // "GIATDC1\0"
+    quint64 key; // ключ : путь, время изменения и хеш содержимого исходного файла
+    quint32 width;
+    quint32 height;
+    quint64 bytes_per_line;
+    quint32 result; // итог decode (GIA_TgaErr)
+    quint8  reserved[28]; // до 64 байтов, чтобы пиксели в отображении были выровнены
+};
+
+struct GIA_TgaMappedImage // изображение из дискового кэша
+{
+    int width;
+    int height;
+    qint64 bytes_per_line;
+    GIA_TgaErr result; // итог decode : Success, TruncDataAbort, TooMuchPixAbort либо ошибка загрузки (тогда data пуст)
+    QSharedPointer<const uchar> data; // пиксели BB GG RR AA, уже приведённые к TopLeft; отображение файла живёт, пока жив указатель
+};
+
+// кэш декодированных изображений в каталоге на диске : при попадании файл кэша отображается в память только для чтения
+class GIA_TgaDiskCache
+{
+    QString cache_dir;
+    qint64 budget_bytes; // предел суммарного размера файлов кэша
+    QAtomicInteger<qint64> used_estimate; // оценка занятого места (каталог могут делить несколько процессов, trim пересчитывает)
+    QMutex trim_lock;
+    QString entry_path(quint64 key); // путь файла кэша по ключу
+    static GIA_TgaMappedImage map_entry(const QString &path, quint64 key); // отображает файл кэша; result = FileIOErr, если файла нет или он не подходит
+public:
+    GIA_TgaDiskCache(const QString &directory, qint64 max_bytes); // каталог создаётся при необходимости
+    GIA_TgaDiskCache(const GIA_TgaDiskCache&) = delete;
+    GIA_TgaDiskCache& operator=(const GIA_TgaDiskCache&) = delete;
+
+    GIA_TgaMappedImage load(const QString &path); // берёт изображение из кэша либо декодирует файл и кладёт результат в кэш
+    void trim(); // удаляет давно неиспользованные файлы кэша, пока занятое место больше предела
+    void clear(); // удаляет все файлы кэша (уже отображённые изображения остаются доступны)
+    qint64 used_bytes(); // суммарный размер файлов кэша в каталоге
 };
 
 }
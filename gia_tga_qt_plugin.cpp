@@ -0,0 +1,132 @@
+#include "gia_tga_qt_plugin.h"
+#include <QImage>
+#include <QIODevice>
+#include <QVariant>
+
+namespace gia_tga_qt
+{
+GIA_TgaIOHandler::GIA_TgaIOHandler()
+{
+    is_loaded = false;
+    is_validated = false;
+    is_valid = false;
+}
+
+bool GIA_TgaIOHandler::canRead(QIODevice *device)
+{
+    if ( device == nullptr ) return false;
+    /// у TGA нет сигнатуры в начале файла : проверяется заголовок вместе с полем id и палитрой (не более 18 + 255 + 256 * 4 байт)
+    QByteArray head = device->peek(sizeof(GIA_TgaHeader) + 255 + 256 * 4);
+    GIA_TgaDecoder probe;
+    probe.init((uchar*)head.data(), head.size());
+    return probe.validate_header() == GIA_TgaErr::ValidHeader;
+}
+
+bool GIA_TgaIOHandler::canRead() const
+{
+    if ( canRead(device()) )
+    {
+        setFormat("tga");
+        return true;
+    }
+    return false;
+}
+
+bool GIA_TgaIOHandler::load_source() const
+{
+    if ( !is_loaded )
+    {
+        is_loaded = true;
+        if ( device() != nullptr ) source = device()->readAll();
+    }
+    if ( !is_validated )
+    {
+        is_validated = true;
+        decoder.init((uchar*)source.data(), source.size());
+        is_valid = decoder.validate_header(0xFFFF, 0xFFFF) == GIA_TgaErr::ValidHeader;
+    }
+    return is_valid;
+}
+
+bool GIA_TgaIOHandler::read(QImage *image)
+{
+    if ( !load_source() ) return false;
+    GIA_TgaInfo info = decoder.info();
+    QRect full_rect(0, 0, info.width, info.height);
+    QRect region = clip_rect.isValid() ? clip_rect.intersected(full_rect) : full_rect;
+    if ( region.isEmpty() ) return false;
+
+    /// целое уменьшение идёт через decode_scaled без полноразмерного буфера, дробный остаток доводит QImage::scaled
+    int factor = 1;
+    if ( scaled_size.isValid() and ( region == full_rect ) and !scaled_size.isEmpty() )
+    {
+        factor = qMin(info.width / scaled_size.width(), info.height / scaled_size.height());
+        factor = qBound(1, factor, 255);
+    }
+    QSize decoded_size = ( factor > 1 ) ? QSize((info.width + factor - 1) / factor, (info.height + factor - 1) / factor) : region.size();
+
+    QImage result(decoded_size, decoder.qimage_format());
+    if ( result.isNull() ) return false;
+    decoder.set_dst_buffer(result.bits(), result.sizeInBytes()); // пиксели раскодируются прямо в память QImage
+    GIA_TgaErr err;
+    if ( factor > 1 ) err = decoder.decode_scaled(quint8(factor));
+    else if ( region != full_rect ) err = decoder.decode_region(region.x(), region.y(), region.width(), region.height());
+    else err = decoder.decode();
+    is_validated = false; // повторное чтение требует новой инициализации декодера
+    if ( ( err != GIA_TgaErr::Success ) and ( err != GIA_TgaErr::TruncDataAbort ) and ( err != GIA_TgaErr::TooMuchPixAbort ) ) return false;
+    decoder.flip();
+
+    if ( scaled_size.isValid() and ( result.size() != scaled_size ) ) result = result.scaled(scaled_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    *image = result;
+    return true;
+}
+
+QVariant GIA_TgaIOHandler::option(ImageOption option) const
+{
+    switch(option)
+    {
+    case Size:
+    {
+        if ( !load_source() ) return QVariant();
+        GIA_TgaInfo info = decoder.info();
+        return QSize(info.width, info.height);
+    }
+    case ImageFormat:
+        return int(decoder.qimage_format());
+    case ScaledSize:
+        return scaled_size;
+    case ClipRect:
+        return clip_rect;
+    default:
+        return QVariant();
+    }
+}
+
+void GIA_TgaIOHandler::setOption(ImageOption option, const QVariant &value)
+{
+    if ( option == ScaledSize ) scaled_size = value.toSize();
+    if ( option == ClipRect ) clip_rect = value.toRect();
+}
+
+bool GIA_TgaIOHandler::supportsOption(ImageOption option) const
+{
+    return ( option == Size ) or ( option == ImageFormat ) or ( option == ScaledSize ) or ( option == ClipRect );
+}
+
+QImageIOPlugin::Capabilities GIA_TgaPlugin::capabilities(QIODevice *device, const QByteArray &format) const
+{
+    if ( format == "tga" ) return CanRead;
+    if ( !format.isEmpty() ) return Capabilities();
+    if ( ( device != nullptr ) and device->isReadable() and GIA_TgaIOHandler::canRead(device) ) return CanRead;
+    return Capabilities();
+}
+
+QImageIOHandler* GIA_TgaPlugin::create(QIODevice *device, const QByteArray &format) const
+{
+    auto handler = new GIA_TgaIOHandler;
+    handler->setDevice(device);
+    handler->setFormat(format);
+    return handler;
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef GIA_TGA_QT_PLUGIN_H
+#define GIA_TGA_QT_PLUGIN_H
+
+#include <QImageIOPlugin>
+#include <QImageIOHandler>
+#include <QByteArray>
+#include <QSize>
+#include <QRect>
+#include "gia_tga_qt.h"
+
+namespace gia_tga_qt
+{
+// обработчик формата "tga" для QImageReader/QPixmap : декодирует прямо в память QImage, без промежуточного dst_array
+class GIA_TgaIOHandler : public QImageIOHandler
+{
+    mutable QByteArray source; // содержимое устройства целиком (декодер работает с объектом в памяти)
+    mutable GIA_TgaDecoder decoder;
+    mutable bool is_loaded; // устройство уже прочитано
+    mutable bool is_validated; // декодер инициализирован и заголовок проверен (сбрасывается после декодирования)
+    mutable bool is_valid; // заголовок прошёл валидацию
+    QSize scaled_size; // QImageIOHandler::ScaledSize
+    QRect clip_rect; // QImageIOHandler::ClipRect
+    bool load_source() const; // читает устройство (один раз) и готовит декодер к очередному декодированию
+public:
+    GIA_TgaIOHandler();
+
+    bool canRead() const override;
+    bool read(QImage *image) override;
+    QVariant option(ImageOption option) const override;
+    void setOption(ImageOption option, const QVariant &value) override;
+    bool supportsOption(ImageOption option) const override;
+
+    static bool canRead(QIODevice *device); // проверка по заголовку без чтения пиксельных данных
+};
+
+class GIA_TgaPlugin : public QImageIOPlugin
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID QImageIOHandlerFactoryInterface_iid FILE "gia_tga_qt_plugin.json")
+public:
+    Capabilities capabilities(QIODevice *device, const QByteArray &format) const override;
+    QImageIOHandler* create(QIODevice *device, const QByteArray &format = QByteArray()) const override;
+};
+
+}
+
+#endif // GIA_TGA_QT_PLUGIN_H
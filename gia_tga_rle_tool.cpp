@@ -0,0 +1,92 @@
+// Перепаковка TGA в оптимальный rle без потерь (типы 9/10/11)
+// Сборка : g++ -std=c++17 -O2 gia_tga_rle_tool.cpp gia_tga_stl.cpp -o gia_tga_rle_tool
+// Запуск : gia_tga_rle_tool <вход.tga> <выход.tga>
+//          gia_tga_rle_tool -i <файл.tga> ... (перезапись на месте, только если файл стал меньше)
+#include "gia_tga_stl.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+
+using namespace gia_tga_stl;
+
+static bool read_file(const char *path, vector<uint8_t> &data)
+{
+    ifstream file(path, ios::binary);
+    if ( !file ) return false;
+    data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+static bool write_file(const char *path, const vector<uint8_t> &data)
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    if ( !file ) return false;
+    file.write((const char*)data.data(), data.size());
+    return bool(file);
+}
+
+// перепаковывает один файл и печатает размеры; in_place - писать в src_path, только если результат меньше
+static bool recompress_file(const char *src_path, const char *dst_path, bool in_place, uint64_t &total_in, uint64_t &total_out)
+{
+    vector<uint8_t> src;
+    if ( !read_file(src_path, src) )
+    {
+        cerr << src_path << " : cannot read file" << endl;
+        return false;
+    }
+
+    GIA_TgaDecoder decoder;
+    decoder.init(src.data(), src.size());
+    GIA_TgaErr err = decoder.validate_header();
+    vector<uint8_t> packed;
+    if ( err == GIA_TgaErr::ValidHeader ) err = decoder.recompress_rle(packed);
+    if ( err != GIA_TgaErr::Success )
+    {
+        cerr << src_path << " : " << decoder.err_str(err) << endl;
+        return false;
+    }
+
+    bool need_write = !in_place or ( packed.size() < src.size() );
+    if ( need_write and !write_file(dst_path, packed) )
+    {
+        cerr << dst_path << " : cannot write file" << endl;
+        return false;
+    }
+
+    uint64_t out_size = need_write ? packed.size() : src.size();
+    total_in += src.size();
+    total_out += out_size;
+    cout << src_path << " : " << src.size() << " -> " << packed.size() << " bytes ("
+         << fixed << setprecision(1) << ( ( src.size() != 0 ) ? 100.0 * packed.size() / src.size() : 0.0 ) << "%)"
+         << ( need_write ? "" : ", kept original" ) << endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    bool in_place = ( argc >= 3 ) and ( string(argv[1]) == "-i" );
+    if ( !in_place and ( argc != 3 ) )
+    {
+        cerr << "usage: gia_tga_rle_tool <input.tga> <output.tga>" << endl
+             << "       gia_tga_rle_tool -i <file.tga> ..." << endl;
+        return 2;
+    }
+
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    int failed = 0;
+    if ( in_place )
+    {
+        for(int idx = 2; idx < argc; ++idx)
+        {
+            if ( !recompress_file(argv[idx], argv[idx], true, total_in, total_out) ) ++failed;
+        }
+        cout << "total : " << total_in << " -> " << total_out << " bytes" << endl;
+    }
+    else
+    {
+        if ( !recompress_file(argv[1], argv[2], false, total_in, total_out) ) ++failed;
+    }
+    return ( failed != 0 ) ? 1 : 0;
+}
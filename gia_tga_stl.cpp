@@ -1,6 +1,43 @@
 #include "gia_tga_stl.h"
 #include <cstring>
 #include <iostream>
+#include <fstream>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define GIA_TGA_SSE2
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define GIA_TGA_POSIX
+#endif
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+#define GIA_TGA_MEMFD // decode_to_shm создаёт запечатываемый memfd, иначе - объект shm_open
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_FEAT_SINGLE_MMAP)
+#define GIA_TGA_URING // пакетный загрузчик читает через io_uring, иначе - пулом потоков с pread
+#endif
+#endif
+#endif
 
 namespace gia_tga_stl
 {
@@ -12,7 +49,14 @@ const vector<string> GIA_TgaDecoder::err_strings = {"format is not valid",
                                                     "memory allocation error",
                                                     "not initialized",
                                                     "need validation before decoding",
-                                                    "need to decode before data detaching"
+                                                    "need to decode before data detaching",
+                                                    "no postage stamp in file",
+                                                    "destination buffer is too small",
+                                                    "region is out of image bounds",
+                                                    "decoding cancelled",
+                                                    "decoding time or pixel budget exceeded",
+                                                    "file input/output error",
+                                                    "rle packet index does not match the object"
                                                     };
 
 const set<uint8_t> GIA_TgaDecoder::valid_img_types = { 1, 2, 3, 9, 10, 11 };
@@ -24,18 +68,58 @@ GIA_TgaDecoder::GIA_TgaDecoder()
     state = FSM_States::NotInitialized;
     is_data_detached = false;
     dst_array = nullptr;
+    own_array = nullptr;
+    own_capacity = 0;
+    own_used = 0;
+    reuse_dst = false;
+    ext_dst_array = nullptr;
+    ext_dst_size = 0;
+    is_dst_external = false;
+    mip_filter = GIA_TgaMipFilter::None;
+    use_color_correction = false;
+    pp_active = false;
+    luts_active = false;
+    premultiply = false;
+    key_mode = GIA_TgaKeyColor::None;
+    key_custom = 0;
+    key_active = false;
+    key_rgb = 0;
+    pm_active = false;
+    alpha_collect = false;
+    alpha_scan = false;
+    stats_enabled = false;
+    stats_scan = false;
+    stats_collected = false;
+    stats_alpha = -1;
+    ctl_band_rows = 64;
+    rle_index_step = 0;
+    ctl_next_pix = INT64_MAX;
+    ctl_stop = GIA_TgaErr::Success;
+    pixel_budget = 0;
+    time_budget = std::chrono::milliseconds(0);
+    cancel_token = nullptr;
+    layout = GIA_TgaLayout::Linear;
+    tile_shift = 6;
+    is_dst_tiled = false;
+    is_dst_compressed = false;
+    is_dst_converted = false;
+    float_format = GIA_TgaFloatFormat::None;
+    float_linear = true;
+    pm_float = false;
+    square_pixels = false;
+    aspect_active = false;
+    aspect_width = 0;
+    aspect_taps = 0;
 }
 
 GIA_TgaDecoder::~GIA_TgaDecoder()
 {
-    if ( !is_data_detached )
-        delete [] dst_array;
+    delete [] own_array; // отсоединённый массив сюда не попадает : detach_data отдаёт его вызывающему
 }
 
 void GIA_TgaDecoder::init(uint8_t *object_ptr, int64_t object_size)
 {
-    if ( !is_data_detached ) delete [] dst_array;
-    is_data_detached = false;
+    release_dst();
 
     src_array = object_ptr;
     src_size = object_size;
@@ -56,11 +140,35 @@ void GIA_TgaDecoder::init(uint8_t *object_ptr, int64_t object_size)
     cmap_elem_depth = 0;
     cmap_elem_size = 0;
     cmap_len = 0;
+    cmap_first = 0;
     id_string.clear();
+    mip_chain.clear();
+    rle_index.clear();
+    ext_dst_array = nullptr;
+    ext_dst_size = 0;
+    is_dst_external = false;
+    is_dst_tiled = false;
+    is_dst_compressed = false;
+    is_dst_converted = false;
 
     state = FSM_States::Initialized;
 }
 
+// может возвращать ошибки : ValidHeader, InvalidHeader
+GIA_TgaErr GIA_TgaDecoder::init(uint8_t *object_ptr, int64_t object_size, const GIA_TgaPackEntry &entry)
+{
+    init(object_ptr, object_size);
+    header_copy = entry.header;
+    header = &header_copy; // заголовок объекта не читается : проверяется копия из индекса, в памяти
+    GIA_TgaErr result = validate_header();
+    if ( ( result == GIA_TgaErr::ValidHeader ) and ( pix_data_offset != int64_t(entry.pix_data_offset) ) ) // запись не соответствует своему заголовку
+    {
+        state = FSM_States::InvalidHeader;
+        result = GIA_TgaErr::InvalidHeader;
+    }
+    return result;
+}
+
 // может возвращать ошибки : ValidHeader, InvalidHeader, NotInitialized
 GIA_TgaErr GIA_TgaDecoder::validate_header(uint16_t max_width, uint16_t max_height)
 {
@@ -73,6 +181,7 @@ GIA_TgaErr GIA_TgaDecoder::validate_header(uint16_t max_width, uint16_t max_heig
     }
     else
     {
+        if ( ( header->width > max_width ) or ( header->height > max_height ) ) is_valid = false;
         if ( header->cmap_type > 1 ) is_valid = false; // неизвестный тип цветовой таблицы
         if ( ( header->cmap_type == 1 ) and ( valid_cmap_depths.find(header->cmap_depth) == valid_cmap_depths.end() ) ) is_valid = false; // есть таблица? проверяем битность её элементов
         if ( valid_img_types.find(header->img_type) == valid_img_types.end() ) is_valid = false;
@@ -92,18 +201,17 @@ GIA_TgaErr GIA_TgaDecoder::validate_header(uint16_t max_width, uint16_t max_heig
         {
             if ( header->pix_depth != 8 ) is_valid = false;
         }
-        if ( header->img_type == 9 )
+        if ( ( header->img_type == 1 ) or ( header->img_type == 9 ) )
         {
             if ( header->cmap_type != 1 ) is_valid = false;
             if ( header->pix_depth != 8 ) is_valid = false;
-            if ( ( header->cmap_depth != 24 ) and ( header->cmap_depth != 32 ) ) is_valid = false;
-            if ( header->cmap_len > 256 ) is_valid = false;
+            if ( header->cmap_start + header->cmap_len > 256 ) is_valid = false; // палитра со смещением должна уместиться в 256 элементов
         }
     }
     if ( is_valid )
     {
         cmap_offset = sizeof(GIA_TgaHeader) + header->id_len;
-        pix_data_offset = cmap_offset + header->cmap_type * (header->cmap_len * (header->cmap_depth / 8));
+        pix_data_offset = cmap_offset + header->cmap_type * (header->cmap_len * ((header->cmap_depth + 7) / 8)); // 15-битные элементы тоже занимают 2 байта
         if ( src_size < pix_data_offset )
         {
             pix_data_offset = -1;
@@ -111,24 +219,24 @@ GIA_TgaErr GIA_TgaDecoder::validate_header(uint16_t max_width, uint16_t max_heig
             is_valid = false;
         }
     }
-    if ( ( header->width > max_width ) or ( header->height > max_height ) ) is_valid = false;
     if ( is_valid )
     {
         one_pix_depth = header->pix_depth;
-        one_pix_size = one_pix_depth / 8;
+        one_pix_size = (one_pix_depth + 7) / 8; // 15-битный пиксель тоже занимает 2 байта
         width = header->width;
         height = header->height;
         bytes_per_line = width * 4; // раскодирование всегда в формат 0xAARRGGBB (little-endian)
-        total_size_p = width * height;
+        total_size_p = int64_t(width) * height; // 65535 x 65535 не помещается в int
         total_size_b = total_size_p * 4; // изображение любого типа всегда раскодируется в формат 0xAARRGGBB; в памяти (и файле) лежит так : BB GG RR AA
         origin = GIA_TgaOrigin(header->img_descr & 0b00110000);
         alpha_bits = header->img_descr & 0b00001111;
         image_type = header->img_type;
         cmap_elem_depth = header->cmap_depth;
-        cmap_elem_size = cmap_elem_depth / 8;
+        cmap_elem_size = (cmap_elem_depth + 7) / 8;
         cmap_len = header->cmap_len;
+        cmap_first = header->cmap_start;
         id_string.clear();
-        for(uint8_t id_idx; id_idx < header->id_len; ++id_idx)
+        for(uint8_t id_idx = 0; id_idx < header->id_len; ++id_idx)
         {
             auto ch = src_array[sizeof(GIA_TgaHeader) + id_idx];
             if ( !ch ) break;
@@ -149,7 +257,14 @@ GIA_TgaErr GIA_TgaDecoder::detach_data()
 {
     if ( ( state == FSM_States::DecodedOK ) or ( state == FSM_States::DecodingAbort ) )
     {
+        if ( ( dst_array != nullptr ) and ( dst_array == own_array ) ) // массив уходит вызывающему : переиспользовать его больше нельзя
+        {
+            own_array = nullptr;
+            own_capacity = 0;
+            own_used = 0;
+        }
         is_data_detached = true;
+        is_dst_external = false; // после отсоединения массив принадлежит вызывающему целиком
         return GIA_TgaErr::Success;
     }
     else
@@ -163,22 +278,29 @@ uint8_t *GIA_TgaDecoder::data()
     return dst_array;
 }
 
-GIA_TgaInfo GIA_TgaDecoder::info()
+// возвращает указатель на область расширений TGA 2.0 либо nullptr, если футера или области нет
+GIA_TgaDecoder::extensions_area* GIA_TgaDecoder::find_ext_area()
 {
-    bool is_footer_valid = true;
     int64_t footer_offset = src_size - sizeof(footer);
     footer *ftr;
     extensions_area *ext_area;
-    string author_str, comment_str, job_str, software_str;
-    size_t find_pos;
-    if ( footer_offset <= pix_data_offset ) goto w_o_footer; // сигнатура футера не поместится в файл
-    if ( memcmp(&(((footer*)&src_array[footer_offset])->signature), "TRUEVISION-XFILE\x2E\x00", 18) != 0 ) goto w_o_footer; // если 0 - сигнатура совпала
+    if ( footer_offset <= pix_data_offset ) return nullptr; // сигнатура футера не поместится в файл
+    if ( memcmp(&(((footer*)&src_array[footer_offset])->signature), "TRUEVISION-XFILE\x2E\x00", 18) != 0 ) return nullptr; // если 0 - сигнатура совпала
     ftr = (footer*)&src_array[footer_offset];
-    if ( ftr->ext_offset < pix_data_offset ) goto w_o_footer; // неверное смещение; либо если 0, значит области расширений нет
-    if ( ftr->ext_offset > src_size ) goto w_o_footer; // неверное смещение
-    if ( src_size - ftr->ext_offset < sizeof(extensions_area) ) goto w_o_footer; // зона расширений не помещается в файл
+    if ( ftr->ext_offset < pix_data_offset ) return nullptr; // неверное смещение; либо если 0, значит области расширений нет
+    if ( ftr->ext_offset > src_size ) return nullptr; // неверное смещение
+    if ( src_size - ftr->ext_offset < sizeof(extensions_area) ) return nullptr; // зона расширений не помещается в файл
     ext_area = (extensions_area*)&src_array[ftr->ext_offset];
-    if ( ext_area->size < sizeof(extensions_area) ) goto w_o_footer; // неизвестный размер, лучше не пытаться прочитать такую область
+    if ( ext_area->size < sizeof(extensions_area) ) return nullptr; // неизвестный размер, лучше не пытаться прочитать такую область
+    return ext_area;
+}
+
+GIA_TgaInfo GIA_TgaDecoder::info()
+{
+    extensions_area *ext_area;
+    string author_str, comment_str, job_str, software_str;
+    ext_area = find_ext_area();
+    if ( ext_area == nullptr ) goto w_o_footer;
 
     author_str.assign(ext_area->author, sizeof(extensions_area::author));
     author_str.erase(author_str.find('\x00'));
@@ -242,12 +364,69 @@ w_o_footer:
     };
 }
 
-void GIA_TgaDecoder::flip_dia()
+// может возвращать ошибки : Success, TruncDataAbort, NoPostageStamp, MemAllocErr, NeedHeaderValidation, NotInitialized
+GIA_TgaErr GIA_TgaDecoder::decode_postage_stamp(GIA_TgaStamp &stamp)
+{
+    if ( state == FSM_States::NotInitialized ) return GIA_TgaErr::NotInitialized;
+    if ( ( state == FSM_States::Initialized ) or ( state == FSM_States::InvalidHeader ) ) return GIA_TgaErr::NeedHeaderValidation;
+
+    extensions_area *ext_area = find_ext_area();
+    if ( ( ext_area == nullptr ) or ( ext_area->stamp_offset == 0 ) ) return GIA_TgaErr::NoPostageStamp;
+    int64_t stamp_offset = ext_area->stamp_offset;
+    if ( ( stamp_offset < pix_data_offset ) or ( int64_t(src_size) - stamp_offset < 2 ) ) return GIA_TgaErr::NoPostageStamp; // неверное смещение
+    uint16_t stamp_width = src_array[stamp_offset]; // миниатюра начинается с байтов ширины и высоты
+    uint16_t stamp_height = src_array[stamp_offset + 1];
+    if ( ( stamp_width == 0 ) or ( stamp_height == 0 ) ) return GIA_TgaErr::NoPostageStamp;
+
+    prepare_pixel_ops(false); // сведения об альфе основного изображения не затираются
+
+    /// миниатюра хранится без сжатия в том же формате пикселей, что и основное изображение
+    bool is_colormapped = ( image_type == 1 ) or ( image_type == 9 );
+    if ( is_colormapped and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) ) return GIA_TgaErr::MemAllocErr;
+
+    stamp.width = stamp_width;
+    stamp.height = stamp_height;
+    stamp.bytes_per_line = stamp_width * 4;
+    stamp.data.resize(stamp.bytes_per_line * stamp_height);
+
+    bool flip_rows = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool flip_cols = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    int64_t src_scln_size = stamp_width * one_pix_size;
+    int64_t src_idx = stamp_offset + 2;
+    bool truncated = false;
+    for(uint16_t scln = 0; scln < stamp_height; ++scln)
+    {
+        auto dst_row = (uint32_t*)&stamp.data[( flip_rows ? stamp_height - 1 - scln : scln ) * stamp.bytes_per_line];
+        if ( int64_t(src_size) - src_idx >= src_scln_size )
+        {
+            convert_pixels(&src_array[src_idx], dst_row, stamp_width);
+            src_idx += src_scln_size;
+        }
+        else // недостающие сканлинии - непрозрачный чёрный, как в decode
+        {
+            truncated = true;
+            for(uint16_t pix_idx = 0; pix_idx < stamp_width; ++pix_idx) dst_row[pix_idx] = 0xFF000000;
+        }
+        if ( flip_cols )
+        {
+            for(uint16_t lpix_idx = 0, rpix_idx = stamp_width - 1; lpix_idx < rpix_idx; ++lpix_idx, --rpix_idx)
+            {
+                uint32_t swap_pixel = dst_row[lpix_idx];
+                dst_row[lpix_idx] = dst_row[rpix_idx];
+                dst_row[rpix_idx] = swap_pixel;
+            }
+        }
+    }
+
+    if ( is_colormapped ) delete [] color_map;
+    return truncated ? GIA_TgaErr::TruncDataAbort : GIA_TgaErr::Success;
+}
+
+void GIA_TgaDecoder::flip_dia(uint32_t *array, int64_t pix_count)
 {
-    auto array = (uint32_t*)dst_array;
     uint32_t swap_pixel;
-    int64_t half_size = total_size_p / 2;
-    int64_t last_idx = total_size_p;
+    int64_t half_size = pix_count / 2;
+    int64_t last_idx = pix_count;
     for(int64_t fwd_idx = 0; fwd_idx < half_size; ++fwd_idx)
     {
         --last_idx;
@@ -257,20 +436,19 @@ void GIA_TgaDecoder::flip_dia()
     }
 }
 
-void GIA_TgaDecoder::flip_ver()
+void GIA_TgaDecoder::flip_ver(uint32_t *array, int64_t flip_width, int64_t flip_height)
 {
-    auto array = (uint32_t*)dst_array;
     uint32_t swap_pixel;
-    uint16_t half_fwd_scln = height / 2; // половина сканлиний
-    uint16_t btm_scln = height; // нижняя сканлиния
+    int64_t half_fwd_scln = flip_height / 2; // половина сканлиний
+    int64_t btm_scln = flip_height; // нижняя сканлиния
     uint32_t *scln_fwd_ptr;
     uint32_t *scln_btm_ptr;
-    for(uint16_t fwd_scln = 0; fwd_scln < half_fwd_scln; ++fwd_scln) // начинаем сверху по сканлиниям и до половины изображения
+    for(int64_t fwd_scln = 0; fwd_scln < half_fwd_scln; ++fwd_scln) // начинаем сверху по сканлиниям и до половины изображения
     {
         --btm_scln;
-        scln_fwd_ptr = &array[fwd_scln * width]; // указатель на верхнюю сканлинию
-        scln_btm_ptr = &array[btm_scln * width]; // указатель на нижнюю сканлинию
-        for(int64_t pix_idx = 0; pix_idx < width; ++pix_idx) // идём по пикселям внутри сканлинии слева направо
+        scln_fwd_ptr = &array[fwd_scln * flip_width]; // указатель на верхнюю сканлинию
+        scln_btm_ptr = &array[btm_scln * flip_width]; // указатель на нижнюю сканлинию
+        for(int64_t pix_idx = 0; pix_idx < flip_width; ++pix_idx) // идём по пикселям внутри сканлинии слева направо
         {
             swap_pixel = scln_fwd_ptr[pix_idx];
             scln_fwd_ptr[pix_idx] = scln_btm_ptr[pix_idx];
@@ -279,18 +457,17 @@ void GIA_TgaDecoder::flip_ver()
     }
 }
 
-void GIA_TgaDecoder::flip_hor()
+void GIA_TgaDecoder::flip_hor(uint32_t *array, int64_t flip_width, int64_t flip_height)
 {
-    auto array = (uint32_t*)dst_array;
     uint32_t swap_pixel;
     uint32_t *scln_ptr;
-    uint16_t half_scln = width / 2; // половина сканлинии
-    uint16_t rpix_idx;
-    for(uint16_t scln = 0; scln < height; ++scln) // идём по всем сканлиниям сверху вниз
+    int64_t half_scln = flip_width / 2; // половина сканлинии
+    int64_t rpix_idx;
+    for(int64_t scln = 0; scln < flip_height; ++scln) // идём по всем сканлиниям сверху вниз
     {
-        scln_ptr = &array[scln * width]; // указатель на текущую сканлинию
-        rpix_idx = width;
-        for(uint16_t lpix_idx = 0; lpix_idx < half_scln; ++lpix_idx)
+        scln_ptr = &array[scln * flip_width]; // указатель на текущую сканлинию
+        rpix_idx = flip_width;
+        for(int64_t lpix_idx = 0; lpix_idx < half_scln; ++lpix_idx)
         {
             --rpix_idx;
             swap_pixel = scln_ptr[lpix_idx];
@@ -302,22 +479,468 @@ void GIA_TgaDecoder::flip_hor()
 
 void GIA_TgaDecoder::flip()
 {
-    if ( ( is_data_detached ) or ( dst_array == nullptr ) ) return;
-    switch(origin)
+    if ( ( is_data_detached and !is_dst_external ) or ( dst_array == nullptr ) or is_dst_tiled or is_dst_compressed or is_dst_converted ) return; // плитки, блоки и float уже в нормальной ориентации
+    int64_t lvl_count = mip_chain.empty() ? 1 : mip_chain.size(); // без мип-уровней переворачивается только само изображение
+    for(int64_t lvl_idx = 0; lvl_idx < lvl_count; ++lvl_idx)
     {
-    case GIA_TgaOrigin::TopRight:
-        flip_hor();
-        break;
-    case GIA_TgaOrigin::BottomLeft:
-        flip_ver();
-        break;
-    case GIA_TgaOrigin::BottomRight:
-        flip_dia();
-        break;
-    case GIA_TgaOrigin::TopLeft:
-    case GIA_TgaOrigin::Unknown:
-        break;
+        uint32_t *array = (uint32_t*)dst_array;
+        int64_t flip_width = width;
+        int64_t flip_height = height;
+        if ( lvl_idx > 0 )
+        {
+            array = (uint32_t*)&dst_array[mip_chain[lvl_idx].offset];
+            flip_width = mip_chain[lvl_idx].width;
+            flip_height = mip_chain[lvl_idx].height;
+        }
+        switch(origin)
+        {
+        case GIA_TgaOrigin::TopRight:
+            flip_hor(array, flip_width, flip_height);
+            break;
+        case GIA_TgaOrigin::BottomLeft:
+            flip_ver(array, flip_width, flip_height);
+            break;
+        case GIA_TgaOrigin::BottomRight:
+            flip_dia(array, int64_t(flip_width) * flip_height);
+            break;
+        case GIA_TgaOrigin::TopLeft:
+        case GIA_TgaOrigin::Unknown:
+            break;
+        }
+    }
+}
+
+void GIA_TgaDecoder::set_mipmaps(GIA_TgaMipFilter filter)
+{
+    mip_filter = filter;
+}
+
+void GIA_TgaDecoder::set_layout(GIA_TgaLayout new_layout, int tile_size)
+{
+    layout = new_layout;
+    tile_shift = 2; // сторона плитки - степень двойки от 4 до 256
+    while ( ( tile_shift < 8 ) and ( ( 1 << tile_shift ) < tile_size ) ) ++tile_shift;
+}
+
+GIA_TgaTileInfo GIA_TgaDecoder::tile_info()
+{
+    if ( layout == GIA_TgaLayout::Linear ) return GIA_TgaTileInfo { layout, 0, 0, 0, 0, total_size_b };
+    int tile_size = 1 << tile_shift;
+    int tiles_x = ( width + tile_size - 1 ) >> tile_shift;
+    int tiles_y = ( height + tile_size - 1 ) >> tile_shift;
+    int64_t tile_bytes = int64_t(tile_size) * tile_size * 4;
+    return GIA_TgaTileInfo { layout, tile_size, tiles_x, tiles_y, tile_bytes, tile_bytes * tiles_x * tiles_y };
+}
+
+uint8_t *GIA_TgaDecoder::tile(int tile_x, int tile_y)
+{
+    if ( !is_dst_tiled or ( dst_array == nullptr ) ) return nullptr;
+    GIA_TgaTileInfo tiles = tile_info();
+    if ( ( tile_x < 0 ) or ( tile_y < 0 ) or ( tile_x >= tiles.tiles_x ) or ( tile_y >= tiles.tiles_y ) ) return nullptr;
+    return &dst_array[( int64_t(tile_y) * tiles.tiles_x + tile_x ) * tiles.tile_bytes];
+}
+
+int64_t GIA_TgaDecoder::pixel_offset(int x, int y)
+{
+    if ( is_dst_compressed ) return -1; // у блоков BC нет отдельных пикселей
+    if ( !is_dst_tiled ) return int64_t(y) * bytes_per_line + int64_t(x) * ( is_dst_converted ? float_pix_size() : 4 ); // линейный массив (после flip)
+    GIA_TgaTileInfo tiles = tile_info();
+    int64_t tile_mask = tiles.tile_size - 1;
+    int64_t offset = ( int64_t(y >> tile_shift) * tiles.tiles_x + ( x >> tile_shift ) ) * tiles.tile_bytes;
+    if ( layout == GIA_TgaLayout::Tiled ) return offset + ( ( ( y & tile_mask ) << tile_shift ) + ( x & tile_mask ) ) * 4;
+    return offset + int64_t( spread_bits(uint32_t(x & tile_mask)) | ( spread_bits(uint32_t(y & tile_mask)) << 1 ) ) * 4;
+}
+
+uint32_t GIA_TgaDecoder::spread_bits(uint32_t value)
+{
+    value = ( value | ( value << 4 ) ) & 0x0F0F;
+    value = ( value | ( value << 2 ) ) & 0x3333;
+    value = ( value | ( value << 1 ) ) & 0x5555;
+    return value;
+}
+
+void GIA_TgaDecoder::set_color_correction(bool enable)
+{
+    use_color_correction = enable;
+}
+
+void GIA_TgaDecoder::prepare_pixel_ops(bool collect_alpha, bool float_out, bool collect_stats)
+{
+    luts_active = false;
+    extensions_area *ext_area = use_color_correction ? find_ext_area() : nullptr;
+    if ( ext_area != nullptr )
+    {
+        for(int ch = 0; ch < 4; ++ch)
+        {
+            for(int idx = 0; idx < 256; ++idx) channel_lut[ch][idx] = uint8_t(idx);
+        }
+        /// таблица цветовой коррекции : 256 элементов по 4 слова A, R, G, B в диапазоне 0..65535
+        if ( ( ext_area->color_offset >= pix_data_offset ) and ( ext_area->color_offset <= src_size ) and ( src_size - ext_area->color_offset >= 256 * 4 * sizeof(uint16_t) ) )
+        {
+            auto cc_table = (uint16_t*)&src_array[ext_area->color_offset];
+            for(int idx = 0; idx < 256; ++idx)
+            {
+                channel_lut[3][idx] = uint8_t( ( cc_table[(idx << 2)] + 128 ) / 257 ); // AA
+                channel_lut[2][idx] = uint8_t( ( cc_table[(idx << 2) + 1] + 128 ) / 257 ); // RR
+                channel_lut[1][idx] = uint8_t( ( cc_table[(idx << 2) + 2] + 128 ) / 257 ); // GG
+                channel_lut[0][idx] = uint8_t( ( cc_table[(idx << 2) + 3] + 128 ) / 257 ); // BB
+            }
+            luts_active = true;
+        }
+        /// гамма : каналы цвета (после коррекции) возводятся в степень 1/gamma, альфа не меняется
+        if ( ( ext_area->gamma_numer != 0 ) and ( ext_area->gamma_denom != 0 ) and ( ext_area->gamma_numer != ext_area->gamma_denom ) )
+        {
+            double inv_gamma = double(ext_area->gamma_denom) / ext_area->gamma_numer;
+            uint8_t gamma_lut[256];
+            for(int idx = 0; idx < 256; ++idx)
+            {
+                gamma_lut[idx] = uint8_t( std::pow(idx / 255.0, inv_gamma) * 255.0 + 0.5 );
+            }
+            for(int ch = 0; ch < 3; ++ch)
+            {
+                for(int idx = 0; idx < 256; ++idx) channel_lut[ch][idx] = gamma_lut[channel_lut[ch][idx]];
+            }
+            luts_active = true;
+        }
+    }
+    /// цветовой ключ : сравниваются только байты цвета исходного пикселя, до таблиц каналов
+    key_active = false;
+    if ( key_mode == GIA_TgaKeyColor::Custom )
+    {
+        key_active = true;
+        key_rgb = key_custom & 0x00FFFFFF;
+    }
+    else if ( key_mode == GIA_TgaKeyColor::FromFile )
+    {
+        extensions_area *key_ext = find_ext_area();
+        key_active = ( key_ext != nullptr );
+        if ( key_active ) key_rgb = key_ext->key_color & 0x00FFFFFF;
+    }
+    /// умножение на альфу не нужно, если альфа заведомо 0xFF, таблица альфы её не меняет и ключ её не обнуляет
+    pm_active = premultiply and !( is_alpha_opaque() and !key_active and ( !luts_active or ( channel_lut[3][255] == 255 ) ) );
+    pm_float = float_out and pm_active; // при выдаче float умножение переносится в convert_row_float, после перевода в линейный свет
+    if ( pm_float ) pm_active = false;
+    /// сведения об альфе : заведомо непрозрачные источники отвечают по заголовку, палитровые - по палитре в create_cmap_256
+    bool is_colormapped = ( image_type == 1 ) or ( image_type == 9 );
+    alpha_collect = collect_alpha;
+    alpha_scan = collect_alpha and !is_colormapped and ( !is_alpha_opaque() or key_active );
+    if ( collect_alpha )
+    {
+        alpha_lo = 255;
+        alpha_hi = 0;
+        alpha_partial = false;
+        if ( !is_colormapped and !alpha_scan ) // исходная альфа 0xFF, возможно переведённая таблицей альфы
+        {
+            alpha_lo = alpha_hi = luts_active ? channel_lut[3][255] : 255;
+            alpha_partial = ( alpha_lo != 0 ) and ( alpha_lo != 255 );
+        }
+    }
+    /// статистику собирает только decode; прочие декодирования (кроме миниатюры) сбрасывают прежнюю
+    stats_scan = stats_enabled and collect_stats;
+    if ( collect_alpha )
+    {
+        stats_collected = stats_scan;
+        stats_alpha = ( !is_colormapped and !alpha_scan ) ? alpha_lo : -1; // одно значение на все пиксели не стоит счётчика на пиксель
+        if ( stats_scan )
+        {
+            memset(stats_hist, 0, sizeof(stats_hist));
+            memset(stats_index, 0, sizeof(stats_index));
+        }
+    }
+    pp_active = key_active or luts_active or pm_active or alpha_scan or stats_scan;
+    /// контроль по сканлиниям : ядра сравнивают счётчик пикселей с ctl_next_pix, без контроля сравнение никогда не срабатывает
+    ctl_width = width;
+    ctl_height = height;
+    ctl_total_pix = int64_t(width) * height;
+    ctl_band_pix = int64_t(ctl_band_rows) * width;
+    ctl_next_band = progress_cb ? ctl_band_pix : INT64_MAX;
+    ctl_each_row = ( cancel_token != nullptr ) or ( pixel_budget > 0 ) or ( time_budget > std::chrono::milliseconds(0) );
+    ctl_next_pix = ctl_each_row ? width : ctl_next_band;
+    ctl_stop = GIA_TgaErr::Success;
+    if ( time_budget > std::chrono::milliseconds(0) ) ctl_deadline = std::chrono::steady_clock::now() + time_budget;
+}
+
+bool GIA_TgaDecoder::band_done(int64_t pix_done)
+{
+    if ( pix_done >= ctl_next_band )
+    {
+        ctl_next_band = ( pix_done / ctl_band_pix + 1 ) * ctl_band_pix;
+        if ( !progress_cb(int(pix_done / ctl_width), ctl_height) ) ctl_stop = GIA_TgaErr::Cancelled;
+    }
+    if ( ctl_each_row and ( ctl_stop == GIA_TgaErr::Success ) and ( pix_done < ctl_total_pix ) ) // после последней сканлинии прерывать уже нечего
+    {
+        if ( ( cancel_token != nullptr ) and cancel_token->load(std::memory_order_relaxed) ) ctl_stop = GIA_TgaErr::Cancelled;
+        else if ( ( pixel_budget > 0 ) and ( pix_done >= pixel_budget ) ) ctl_stop = GIA_TgaErr::BudgetExceeded;
+        else if ( ( time_budget > std::chrono::milliseconds(0) ) and ( std::chrono::steady_clock::now() >= ctl_deadline ) ) ctl_stop = GIA_TgaErr::BudgetExceeded;
+    }
+    if ( ctl_stop != GIA_TgaErr::Success ) return false;
+    int64_t next_row = ( pix_done / ctl_width + 1 ) * ctl_width;
+    ctl_next_pix = ( ctl_each_row and ( next_row < ctl_next_band ) ) ? next_row : ctl_next_band;
+    return true;
+}
+
+std::future<GIA_TgaErr> GIA_TgaDecoder::decode_async()
+{
+    if ( state != FSM_States::HeaderValidated ) // ошибку можно отдать сразу, без потока
+    {
+        std::promise<GIA_TgaErr> ready;
+        ready.set_value(GIA_TgaErr::NeedHeaderValidation);
+        return ready.get_future();
+    }
+    return std::async(std::launch::async, &GIA_TgaDecoder::decode, this);
+}
+
+void GIA_TgaDecoder::set_cancel_token(const std::atomic<bool> *token)
+{
+    cancel_token = token;
+}
+
+void GIA_TgaDecoder::set_budget(std::chrono::milliseconds time_limit, int64_t pixel_limit)
+{
+    time_budget = time_limit;
+    pixel_budget = pixel_limit;
+}
+
+void GIA_TgaDecoder::set_progress(GIA_TgaProgress callback, int band_rows)
+{
+    progress_cb = callback;
+    ctl_band_rows = ( band_rows > 0 ) ? band_rows : 1;
+}
+
+void GIA_TgaDecoder::scan_alpha(const uint32_t *pixels, int64_t count)
+{
+    int64_t pix_idx = 0;
+#ifdef GIA_TGA_SSE2
+    if ( count >= 4 )
+    {
+        const __m128i alpha_mask = _mm_set1_epi32(int(0xFF000000));
+        const __m128i color_fill = _mm_set1_epi32(0x00FFFFFF); // байты цвета не должны влиять на минимум
+        const __m128i zero = _mm_setzero_si128();
+        __m128i min4 = _mm_set1_epi32(-1);
+        __m128i max4 = zero;
+        __m128i partial4 = zero;
+        for(; pix_idx + 4 <= count; pix_idx += 4) // по 4 пикселя за итерацию
+        {
+            __m128i alpha4 = _mm_and_si128(_mm_loadu_si128((const __m128i*)&pixels[pix_idx]), alpha_mask); // остаются только байты альфы
+            min4 = _mm_min_epu8(min4, _mm_or_si128(alpha4, color_fill));
+            max4 = _mm_max_epu8(max4, alpha4);
+            __m128i edge4 = _mm_or_si128(_mm_cmpeq_epi32(alpha4, alpha_mask), _mm_cmpeq_epi32(alpha4, zero)); // альфа 255 или 0
+            partial4 = _mm_or_si128(partial4, _mm_cmpeq_epi32(edge4, zero));
+        }
+        alignas(16) uint8_t min_bytes[16];
+        alignas(16) uint8_t max_bytes[16];
+        _mm_store_si128((__m128i*)min_bytes, min4);
+        _mm_store_si128((__m128i*)max_bytes, max4);
+        for(int b_idx = 3; b_idx < 16; b_idx += 4)
+        {
+            if ( min_bytes[b_idx] < alpha_lo ) alpha_lo = min_bytes[b_idx];
+            if ( max_bytes[b_idx] > alpha_hi ) alpha_hi = max_bytes[b_idx];
+        }
+        if ( _mm_movemask_epi8(partial4) != 0 ) alpha_partial = true;
     }
+#endif
+    for(; pix_idx < count; ++pix_idx)
+    {
+        uint8_t alpha = uint8_t(pixels[pix_idx] >> 24);
+        if ( alpha < alpha_lo ) alpha_lo = alpha;
+        if ( alpha > alpha_hi ) alpha_hi = alpha;
+        if ( ( alpha != 0 ) and ( alpha != 255 ) ) alpha_partial = true;
+    }
+}
+
+GIA_TgaAlpha GIA_TgaDecoder::alpha_info()
+{
+    GIA_TgaAlpha result { GIA_TgaAlphaKind::Unknown, 0, 0 };
+    if ( ( state != FSM_States::DecodedOK ) and ( state != FSM_States::DecodingAbort ) ) return result;
+    result.min = alpha_lo;
+    result.max = alpha_hi;
+    if ( alpha_lo == 255 ) result.kind = GIA_TgaAlphaKind::Opaque;
+    else if ( !alpha_partial ) result.kind = GIA_TgaAlphaKind::Binary;
+    else result.kind = GIA_TgaAlphaKind::Translucent;
+    return result;
+}
+
+bool GIA_TgaDecoder::is_alpha_opaque()
+{
+    switch(image_type)
+    {
+    case 1: // colormapped
+    case 9:
+        return ( cmap_elem_depth == 15 ) or ( cmap_elem_depth == 24 ) or ( ( cmap_elem_depth == 16 ) and ( alpha_bits != 1 ) );
+    case 3: // grayscale
+    case 11:
+        return true;
+    default: // truecolor
+        return ( one_pix_depth == 15 ) or ( one_pix_depth == 24 );
+    }
+}
+
+void GIA_TgaDecoder::set_premultiplied(bool enable)
+{
+    premultiply = enable;
+}
+
+void GIA_TgaDecoder::premultiply_pixels(uint32_t *pixels, int64_t count)
+{
+    int64_t pix_idx = 0;
+#ifdef GIA_TGA_SSE2
+    const __m128i alpha_mask = _mm_set1_epi32(int(0xFF000000));
+    const __m128i round_128 = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    for(; pix_idx + 4 <= count; pix_idx += 4) // по 4 пикселя за итерацию
+    {
+        __m128i pix4 = _mm_loadu_si128((__m128i*)&pixels[pix_idx]);
+        if ( _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(pix4, alpha_mask), alpha_mask)) == 0xFFFF ) continue; // все 4 пикселя непрозрачные
+        __m128i lo = _mm_unpacklo_epi8(pix4, zero); // b0 g0 r0 a0 b1 g1 r1 a1 в словах
+        __m128i hi = _mm_unpackhi_epi8(pix4, zero);
+        __m128i alpha_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF); // a0 x4, a1 x4
+        __m128i alpha_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+        /// x / 255 с округлением : t = x + 128; (t + (t >> 8)) >> 8 - точно для x <= 255 * 255
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, alpha_lo), round_128);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, alpha_hi), round_128);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        __m128i result = _mm_packus_epi16(lo, hi);
+        result = _mm_or_si128(_mm_andnot_si128(alpha_mask, result), _mm_and_si128(pix4, alpha_mask)); // альфа остаётся исходной
+        _mm_storeu_si128((__m128i*)&pixels[pix_idx], result);
+    }
+#endif
+    auto pix_bytes = (uint8_t*)pixels;
+    for(int64_t b_idx = pix_idx << 2; b_idx < (count << 2); b_idx += 4)
+    {
+        uint32_t alpha = pix_bytes[b_idx + 3];
+        if ( alpha == 255 ) continue;
+        for(int ch = 0; ch < 3; ++ch)
+        {
+            uint32_t tmp = pix_bytes[b_idx + ch] * alpha + 128;
+            pix_bytes[b_idx + ch] = uint8_t( ( tmp + ( tmp >> 8 ) ) >> 8 );
+        }
+    }
+}
+
+void GIA_TgaDecoder::set_key_color(GIA_TgaKeyColor mode, uint32_t color)
+{
+    key_mode = mode;
+    key_custom = color;
+}
+
+void GIA_TgaDecoder::mask_key_color(uint32_t *pixels, int64_t count)
+{
+    int64_t pix_idx = 0;
+#ifdef GIA_TGA_SSE2
+    const __m128i color_mask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i key4 = _mm_set1_epi32(int(key_rgb));
+    for(; pix_idx + 4 <= count; pix_idx += 4) // по 4 пикселя за итерацию
+    {
+        __m128i pix4 = _mm_loadu_si128((__m128i*)&pixels[pix_idx]);
+        __m128i hit4 = _mm_cmpeq_epi32(_mm_and_si128(pix4, color_mask), key4); // 0xFFFFFFFF у пикселей цвета ключа
+        if ( _mm_movemask_epi8(hit4) == 0 ) continue; // в четвёрке нет цвета ключа
+        _mm_storeu_si128((__m128i*)&pixels[pix_idx], _mm_andnot_si128(hit4, pix4));
+    }
+#endif
+    for(; pix_idx < count; ++pix_idx)
+    {
+        if ( ( pixels[pix_idx] & 0x00FFFFFF ) == key_rgb ) pixels[pix_idx] = 0;
+    }
+}
+
+void GIA_TgaDecoder::process_pixels(uint32_t *pixels, int64_t count, uint64_t weight)
+{
+    if ( key_active ) mask_key_color(pixels, count); // ключ сравнивается с исходным цветом, поэтому - раньше таблиц каналов
+    auto pix_bytes = (uint8_t*)pixels;
+    if ( luts_active )
+    {
+        for(int64_t b_idx = 0; b_idx < (count << 2); b_idx += 4)
+        {
+            pix_bytes[b_idx] = channel_lut[0][pix_bytes[b_idx]];
+            pix_bytes[b_idx + 1] = channel_lut[1][pix_bytes[b_idx + 1]];
+            pix_bytes[b_idx + 2] = channel_lut[2][pix_bytes[b_idx + 2]];
+            pix_bytes[b_idx + 3] = channel_lut[3][pix_bytes[b_idx + 3]];
+        }
+    }
+    if ( alpha_scan ) scan_alpha(pixels, count);
+    if ( pm_active ) premultiply_pixels(pixels, count);
+    if ( stats_scan and ( weight != 0 ) ) add_stats(pixels, count, weight); // учитываются выдаваемые значения
+}
+
+void GIA_TgaDecoder::add_stats(const uint32_t *pixels, int64_t count, uint64_t weight)
+{
+    /// соседние пиксели часто совпадают : два набора гистограмм разрывают цепочку зависимостей через один и тот же счётчик
+    auto pix_bytes = (const uint8_t*)pixels;
+    auto add = uint32_t(weight);
+    bool scan_alpha = ( stats_alpha < 0 );
+    int64_t b_idx = 0;
+    for(; b_idx + 8 <= (count << 2); b_idx += 8) // по 2 пикселя за итерацию
+    {
+        stats_hist[0][0][pix_bytes[b_idx]] += add;
+        stats_hist[1][0][pix_bytes[b_idx + 4]] += add;
+        stats_hist[0][1][pix_bytes[b_idx + 1]] += add;
+        stats_hist[1][1][pix_bytes[b_idx + 5]] += add;
+        stats_hist[0][2][pix_bytes[b_idx + 2]] += add;
+        stats_hist[1][2][pix_bytes[b_idx + 6]] += add;
+        if ( scan_alpha )
+        {
+            stats_hist[0][3][pix_bytes[b_idx + 3]] += add;
+            stats_hist[1][3][pix_bytes[b_idx + 7]] += add;
+        }
+    }
+    if ( b_idx < (count << 2) )
+    {
+        stats_hist[0][0][pix_bytes[b_idx]] += add;
+        stats_hist[0][1][pix_bytes[b_idx + 1]] += add;
+        stats_hist[0][2][pix_bytes[b_idx + 2]] += add;
+        if ( scan_alpha ) stats_hist[0][3][pix_bytes[b_idx + 3]] += add;
+    }
+}
+
+void GIA_TgaDecoder::set_stats(bool enable)
+{
+    stats_enabled = enable;
+}
+
+GIA_TgaStats GIA_TgaDecoder::stats()
+{
+    GIA_TgaStats result;
+    memset(&result, 0, sizeof(result));
+    if ( !stats_collected or ( ( state != FSM_States::DecodedOK ) and ( state != FSM_States::DecodingAbort ) ) ) return result;
+    for(int ch = 0; ch < 4; ++ch)
+    {
+        for(int val = 0; val < 256; ++val) result.histogram[ch][val] = uint64_t(stats_hist[0][ch][val]) + stats_hist[1][ch][val];
+    }
+    if ( stats_alpha >= 0 ) // заведомо одинаковая альфа : у каждого учтённого пикселя
+    {
+        for(int val = 0; val < 256; ++val) result.histogram[3][stats_alpha] += result.histogram[0][val];
+    }
+    for(int idx = 0; idx < 256; ++idx) // палитровые пиксели : счётчик индекса на цвет элемента палитры
+    {
+        if ( stats_index[idx] == 0 ) continue;
+        auto pal_bytes = (const uint8_t*)&stats_palette[idx];
+        for(int ch = 0; ch < 4; ++ch) result.histogram[ch][pal_bytes[ch]] += stats_index[idx];
+    }
+    for(int ch = 0; ch < 4; ++ch)
+    {
+        uint64_t ch_pixels = 0;
+        double ch_sum = 0.0;
+        result.min[ch] = 255;
+        for(int val = 0; val < 256; ++val)
+        {
+            uint64_t val_cnt = result.histogram[ch][val];
+            if ( val_cnt == 0 ) continue;
+            if ( ch_pixels == 0 ) result.min[ch] = uint8_t(val);
+            result.max[ch] = uint8_t(val);
+            ch_pixels += val_cnt;
+            ch_sum += double(val_cnt) * val;
+        }
+        result.pixels = int64_t(ch_pixels);
+        result.mean[ch] = ( ch_pixels != 0 ) ? ch_sum / ch_pixels : 0.0;
+    }
+    if ( result.pixels == 0 ) result.min[0] = result.min[1] = result.min[2] = result.min[3] = 0;
+    return result;
+}
+
+const vector<GIA_TgaMipLevel> &GIA_TgaDecoder::mip_levels()
+{
+    return mip_chain;
 }
 
 inline void GIA_TgaDecoder::fill_with_dword(uint32_t value, void *dst_start, uint8_t count)
@@ -343,77 +966,1745 @@ void GIA_TgaDecoder::fill_with_zeroes()
     }
 }
 
+/// float -> half (IEEE 754 binary16) с округлением к ближайшему чётному; значения вне диапазона half дают бесконечность
+static uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    uint16_t sign = uint16_t(( bits >> 16 ) & 0x8000);
+    int32_t exponent = int32_t(( bits >> 23 ) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x007FFFFF;
+    if ( exponent >= 31 ) return uint16_t(sign | 0x7C00); // переполнение (NaN во входных данных не встречается)
+    if ( exponent <= 0 ) // денормализованное half или ноль
+    {
+        if ( exponent < -10 ) return sign;
+        mantissa |= 0x00800000;
+        int shift = 14 - exponent;
+        uint32_t half_mant = mantissa >> shift;
+        uint32_t rest = mantissa & ( ( 1u << shift ) - 1 );
+        uint32_t halfway = 1u << ( shift - 1 );
+        if ( ( rest > halfway ) or ( ( rest == halfway ) and ( half_mant & 1 ) ) ) ++half_mant;
+        return uint16_t(sign | half_mant);
+    }
+    uint32_t half_bits = ( uint32_t(exponent) << 10 ) | ( mantissa >> 13 );
+    uint32_t rest = mantissa & 0x1FFF;
+    if ( ( rest > 0x1000 ) or ( ( rest == 0x1000 ) and ( half_bits & 1 ) ) ) ++half_bits; // перенос в порядок даёт верный результат
+    return uint16_t(sign | half_bits);
+}
+
+/// таблицы перевода sRGB <-> линейный свет для фильтра GIA_TgaMipFilter::BoxSRGB и выдачи float/half
+struct srgb_luts
+{
+    uint16_t to_linear[256]; // sRGB (8 бит) -> линейный свет (16 бит)
+    uint8_t to_srgb[65536]; // линейный свет (16 бит) -> sRGB (8 бит), без потери точности в тенях
+    float linear_f[256]; // sRGB (8 бит) -> линейный свет (float)
+    float unorm_f[256]; // байт -> [0, 1] (float), для альфы и для цвета без перевода
+    uint16_t linear_h[256]; // то же, что linear_f, в half
+    uint16_t unorm_h[256]; // то же, что unorm_f, в half
+    srgb_luts()
+    {
+        for(int idx = 0; idx < 256; ++idx)
+        {
+            double srgb = idx / 255.0;
+            double lin = ( srgb <= 0.04045 ) ? srgb / 12.92 : std::pow((srgb + 0.055) / 1.055, 2.4);
+            to_linear[idx] = uint16_t(lin * 65535.0 + 0.5);
+            linear_f[idx] = float(lin);
+            unorm_f[idx] = float(srgb);
+            linear_h[idx] = float_to_half(linear_f[idx]);
+            unorm_h[idx] = float_to_half(unorm_f[idx]);
+        }
+        /// значение code выдаётся, пока линейный свет меньше середины между code и code + 1 (округление к ближайшему)
+        int lin_idx = 0;
+        for(int code = 0; code < 255; ++code)
+        {
+            double srgb_mid = ( code + 0.5 ) / 255.0;
+            double lin_mid = ( srgb_mid <= 0.04045 ) ? srgb_mid / 12.92 : std::pow((srgb_mid + 0.055) / 1.055, 2.4);
+            for(; ( lin_idx < 65536 ) and ( lin_idx / 65535.0 < lin_mid ); ++lin_idx) to_srgb[lin_idx] = uint8_t(code);
+        }
+        for(; lin_idx < 65536; ++lin_idx) to_srgb[lin_idx] = 255;
+    }
+};
+
+static const srgb_luts& srgb_tables()
+{
+    static const srgb_luts tables; // строятся один раз при первом обращении
+    return tables;
+}
+
+int64_t GIA_TgaDecoder::mip_chain_size()
+{
+    int64_t chain_size = 0;
+    int64_t lvl_width = width;
+    int64_t lvl_height = height;
+    while ( ( lvl_width > 1 ) or ( lvl_height > 1 ) )
+    {
+        lvl_width = ( lvl_width > 1 ) ? lvl_width / 2 : 1;
+        lvl_height = ( lvl_height > 1 ) ? lvl_height / 2 : 1;
+        chain_size += lvl_width * lvl_height * 4;
+    }
+    return chain_size;
+}
+
+void GIA_TgaDecoder::build_mipmaps()
+{
+    mip_chain.clear();
+    mip_chain.push_back(GIA_TgaMipLevel{width, height, bytes_per_line, 0});
+    /// при нечётном размере отбрасывается тот крайний столбец (сканлиния), который после flip() окажется справа (снизу),
+    /// поэтому перевёрнутая цепочка совпадает с цепочкой, построенной по уже перевёрнутому изображению
+    bool skip_first_col = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool skip_first_row = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    int64_t lvl_offset = total_size_b;
+    while ( ( mip_chain.back().width > 1 ) or ( mip_chain.back().height > 1 ) )
+    {
+        GIA_TgaMipLevel src_lvl = mip_chain.back();
+        GIA_TgaMipLevel dst_lvl;
+        dst_lvl.width = ( src_lvl.width > 1 ) ? src_lvl.width / 2 : 1;
+        dst_lvl.height = ( src_lvl.height > 1 ) ? src_lvl.height / 2 : 1;
+        dst_lvl.bytes_per_line = dst_lvl.width * 4;
+        dst_lvl.offset = lvl_offset;
+        reduce_level(src_lvl, dst_lvl, skip_first_col, skip_first_row);
+        lvl_offset += dst_lvl.bytes_per_line * dst_lvl.height;
+        mip_chain.push_back(dst_lvl);
+    }
+}
+
+// уменьшает уровень src_lvl вдвое в уровень dst_lvl, каждый пиксель - среднее квадрата 2x2 (или 2x1/1x2 у вырожденных уровней)
+void GIA_TgaDecoder::reduce_level(const GIA_TgaMipLevel &src_lvl, const GIA_TgaMipLevel &dst_lvl, bool skip_first_col, bool skip_first_row)
+{
+    int64_t col_skip = ( skip_first_col and ( src_lvl.width > 1 ) and ( src_lvl.width % 2 ) ) ? 4 : 0; // смещение в байтах начала первой пары пикселей
+    int64_t row_skip = ( skip_first_row and ( src_lvl.height > 1 ) and ( src_lvl.height % 2 ) ) ? 1 : 0;
+    int64_t pair_step = ( src_lvl.width > 1 ) ? 4 : 0; // байтовое смещение второго пикселя пары
+    int64_t row_step = ( src_lvl.height > 1 ) ? src_lvl.bytes_per_line : 0; // байтовое смещение второй сканлинии пары
+    for(int64_t dst_scln = 0; dst_scln < dst_lvl.height; ++dst_scln)
+    {
+        uint8_t *src_row = &dst_array[src_lvl.offset + ( ( dst_scln << (src_lvl.height > 1 ? 1 : 0) ) + row_skip ) * src_lvl.bytes_per_line + col_skip];
+        uint8_t *dst_row = &dst_array[dst_lvl.offset + dst_scln * dst_lvl.bytes_per_line];
+        int64_t pix_idx = 0;
+        if ( mip_filter == GIA_TgaMipFilter::BoxSRGB )
+        {
+            const srgb_luts &luts = srgb_tables();
+            for(; pix_idx < dst_lvl.width; ++pix_idx)
+            {
+                uint8_t *quad = &src_row[pix_idx * (pair_step << 1)];
+                for(int ch = 0; ch < 3; ++ch) // BB, GG, RR - в линейном свете
+                {
+                    uint32_t sum = luts.to_linear[quad[ch]] + luts.to_linear[quad[pair_step + ch]]
+                                 + luts.to_linear[quad[row_step + ch]] + luts.to_linear[quad[row_step + pair_step + ch]];
+                    dst_row[(pix_idx << 2) + ch] = luts.to_srgb[(sum + 2) >> 2]; // среднее четырёх с округлением
+                }
+                dst_row[(pix_idx << 2) + 3] = ( quad[3] + quad[pair_step + 3] + quad[row_step + 3] + quad[row_step + pair_step + 3] + 2 ) >> 2; // альфа линейна
+            }
+            continue;
+        }
+#ifdef GIA_TGA_SSE2
+        if ( pair_step == 4 )
+        {
+            /// 4 пикселя из каждой из двух сканлиний -> 2 пикселя результата за итерацию
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi16(2);
+            for(; pix_idx + 2 <= dst_lvl.width; pix_idx += 2)
+            {
+                __m128i top = _mm_loadu_si128((const __m128i*)&src_row[pix_idx << 3]);
+                __m128i btm = _mm_loadu_si128((const __m128i*)&src_row[row_step + (pix_idx << 3)]);
+                __m128i sum_lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(btm, zero)); // пиксели 0 и 1 по 16 бит на канал
+                __m128i sum_hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(btm, zero)); // пиксели 2 и 3
+                sum_lo = _mm_add_epi16(sum_lo, _mm_srli_si128(sum_lo, 8)); // в младших 64 битах сумма пикселей 0+1
+                sum_hi = _mm_add_epi16(sum_hi, _mm_srli_si128(sum_hi, 8)); // в младших 64 битах сумма пикселей 2+3
+                __m128i avg = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sum_lo, sum_hi), round), 2);
+                _mm_storel_epi64((__m128i*)&dst_row[pix_idx << 2], _mm_packus_epi16(avg, zero));
+            }
+        }
+#endif
+        for(; pix_idx < dst_lvl.width; ++pix_idx)
+        {
+            uint8_t *quad = &src_row[pix_idx * (pair_step << 1)];
+            for(int ch = 0; ch < 4; ++ch)
+            {
+                dst_row[(pix_idx << 2) + ch] = ( quad[ch] + quad[pair_step + ch] + quad[row_step + ch] + quad[row_step + pair_step + ch] + 2 ) >> 2;
+            }
+        }
+    }
+}
+
 // может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, NeedHeaderValidation
 GIA_TgaErr GIA_TgaDecoder::decode()
 {
     if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    if ( prepare_aspect() or ( float_format != GIA_TgaFloatFormat::None ) ) return decode_converted(); // сканлиния передискретизируется и/или переводится во float сразу после раскодирования
+    if ( layout != GIA_TgaLayout::Linear ) return decode_tiled(); // плитки собираются из сканлиний без промежуточного линейного массива
 
-    if ( !is_data_detached ) delete [] dst_array;
-    is_data_detached = false;
+    release_dst();
 
-    dst_array = new (std::nothrow) uint8_t[total_size_b];
+    prepare_pixel_ops(true, false, true);
 
-    if ( dst_array == nullptr )
-    {
-        return GIA_TgaErr::MemAllocErr;
-    }
+    int64_t alloc_size = total_size_b;
+    if ( mip_filter != GIA_TgaMipFilter::None ) alloc_size += mip_chain_size(); // мип-уровни живут в том же массиве сразу за изображением
+
+    GIA_TgaErr alloc_result = alloc_dst(alloc_size);
+    if ( alloc_result != GIA_TgaErr::Success ) return alloc_result;
 
     fill_with_zeroes(); // обнуление dst_array
 
+    GIA_TgaErr result = GIA_TgaErr::InvalidHeader; // глубина вне ветвей switch отсечена validate_header
     switch(image_type)
     {
     case 1: // non-rle colormapped
     {
-        return decode_cm_8();
+        result = decode_cm_8();
+        break;
     }
     case 2: // non-rle truecolor
     {
         switch(one_pix_depth)
         {
         case 15:
-            return decode_tc_15();
+            result = decode_tc_15();
+            break;
         case 16:
-            return decode_tc_16();
+            result = decode_tc_16();
+            break;
         case 24:
-            return decode_tc_24();
+            result = decode_tc_24();
+            break;
         case 32:
-            return decode_tc_32();
+            result = decode_tc_32();
+            break;
         }
+        break;
     }
     case 3: // non-rle grayscale
     {
-        return decode_gr_8();
+        result = decode_gr_8();
+        break;
     }
     case 10: // rle truecolor
     {
         switch(one_pix_depth)
         {
         case 15:
-            return decode_tc_rle15();
+            result = decode_tc_rle15();
+            break;
         case 16:
-            return decode_tc_rle16();
+            result = decode_tc_rle16();
+            break;
         case 24:
-            return decode_tc_rle24();
+            result = decode_tc_rle24();
+            break;
         case 32:
-            return decode_tc_rle32();
+            result = decode_tc_rle32();
+            break;
         }
+        break;
     }
     case 9: // rle colormapped
     {
-        return decode_cm_rle8();
+        result = decode_cm_rle8();
+        break;
     }
     case 11: // rle grayscale
     {
-        return decode_gr_rle8();
+        result = decode_gr_rle8();
+        break;
     }
     default:
     {
         return GIA_TgaErr::InvalidHeader;
     }
     }
+
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недокачанный (или брошенный) хвост остаётся непрозрачным чёрным после fill_with_zeroes
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    /// мип-уровни строятся сразу после декодирования, пока свежие данные ещё в кэше; недокачанное изображение тоже получает цепочку
+    if ( ( mip_filter != GIA_TgaMipFilter::None ) and ( result != GIA_TgaErr::MemAllocErr ) and ( ctl_stop == GIA_TgaErr::Success ) ) build_mipmaps(); // прерванное декодирование цепочку не строит
+
+    return result;
 }
 
-// может возвращать ошибки : MemAllocErr, Success
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, SmallBuffer, Cancelled, BudgetExceeded
+GIA_TgaErr GIA_TgaDecoder::decode_tiled()
+{
+    release_dst();
+
+    prepare_pixel_ops(true, false, true);
+
+    GIA_TgaTileInfo tiles = tile_info();
+    int64_t tile_pix = tiles.tile_bytes >> 2;
+    int64_t tile_mask = tiles.tile_size - 1;
+    auto row = new (std::nothrow) uint32_t[width]; // сканлиния раскодируется сюда и сразу раскладывается по плиткам, пока горячая
+    if ( row == nullptr ) return GIA_TgaErr::MemAllocErr;
+    GIA_TgaErr result = alloc_dst(tiles.total_size);
+    if ( result != GIA_TgaErr::Success )
+    {
+        delete [] row;
+        return result;
+    }
+    memset(dst_array, 0, tiles.total_size); // поля краевых плиток за пределами изображения - прозрачные; само изображение записывается целиком, включая остаток
+    is_dst_tiled = true;
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        delete [] row;
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    uint32_t morton_x[256]; // разнесённые биты столбца внутри плитки
+    for(int64_t lx = 0; lx < tiles.tile_size; ++lx) morton_x[lx] = spread_bits(uint32_t(lx));
+    /// плитки сразу получают нормальную ориентацию : сканлиния кладётся на своё место, а при правом начале координат предварительно разворачивается
+    bool bottom_origin = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool right_origin = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    row_reader reader;
+    reader_start(reader);
+    for(int64_t src_scln = 0; src_scln < height; ++src_scln)
+    {
+        if ( result == GIA_TgaErr::Success )
+        {
+            result = read_pixels(reader, row, width);
+        }
+        else // после обрыва данных или остановки остаток изображения - непрозрачный чёрный, как в decode
+        {
+            for(int64_t pix_idx = 0; pix_idx < width; ++pix_idx) row[pix_idx] = 0xFF000000;
+        }
+        if ( right_origin ) flip_hor(row, width, 1);
+        int64_t dst_scln = bottom_origin ? height - 1 - src_scln : src_scln;
+        auto tile_row = (uint32_t*)&dst_array[( dst_scln >> tile_shift ) * tiles.tiles_x * tiles.tile_bytes]; // первая плитка ряда плиток
+        int64_t ly = dst_scln & tile_mask;
+        if ( layout == GIA_TgaLayout::Tiled ) // в плитке сканлиния непрерывна
+        {
+            uint32_t *dst = &tile_row[ly << tile_shift];
+            for(int64_t pix_idx = 0; pix_idx < width; pix_idx += tiles.tile_size, dst += tile_pix)
+            {
+                memcpy(dst, &row[pix_idx], ( ( width - pix_idx < tiles.tile_size ) ? width - pix_idx : tiles.tile_size ) * 4);
+            }
+        }
+        else // Z-порядок : код Morton складывается из разнесённых битов столбца и строки
+        {
+            uint32_t morton_y = spread_bits(uint32_t(ly)) << 1;
+            for(int64_t pix_idx = 0; pix_idx < width; ++pix_idx)
+            {
+                tile_row[( ( pix_idx >> tile_shift ) * tile_pix ) + ( morton_x[pix_idx & tile_mask] | morton_y )] = row[pix_idx];
+            }
+        }
+        int64_t src_done = ( src_scln + 1 ) * width;
+        if ( ( ctl_stop == GIA_TgaErr::Success ) and ( src_done >= ctl_next_pix ) and !band_done(src_done) ) result = ctl_stop; // остальные сканлинии раскладываются по плиткам уже чёрными
+    }
+    if ( ( result == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort;
+
+    delete [] row;
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недостающие и брошенные пиксели - непрозрачный чёрный
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    return result;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, SmallBuffer, Cancelled, BudgetExceeded
+GIA_TgaErr GIA_TgaDecoder::decode_converted()
+{
+    release_dst();
+
+    prepare_pixel_ops(true, float_format != GIA_TgaFloatFormat::None, true);
+
+    int64_t src_width = width;
+    auto row = new (std::nothrow) uint32_t[src_width + 1 + aspect_width]; // сканлиния раскодируется сюда и сразу переводится, пока горячая
+    if ( row == nullptr ) return GIA_TgaErr::MemAllocErr;
+    row[src_width] = 0; // запасной пиксель под нулевой парный вес передискретизации
+    int64_t out_line = int64_t(aspect_width) * float_pix_size();
+    GIA_TgaErr result = alloc_dst(out_line * height);
+    if ( result != GIA_TgaErr::Success )
+    {
+        delete [] row;
+        return result;
+    }
+    width = aspect_width; // с этого момента размеры описывают выдаваемое изображение, исходные размеры остаются в заголовке
+    bytes_per_line = out_line;
+    total_size_p = int64_t(width) * height;
+    total_size_b = out_line * height;
+    is_dst_converted = true;
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        delete [] row;
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    /// сканлиния сразу кладётся на своё место в нормальной ориентации
+    bool bottom_origin = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool right_origin = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    row_reader reader;
+    reader_start(reader);
+    for(int64_t src_scln = 0; src_scln < height; ++src_scln)
+    {
+        if ( result == GIA_TgaErr::Success )
+        {
+            result = read_pixels(reader, row, src_width);
+        }
+        else // после обрыва данных или остановки остаток изображения - непрозрачный чёрный, как в decode
+        {
+            for(int64_t pix_idx = 0; pix_idx < src_width; ++pix_idx) row[pix_idx] = 0xFF000000;
+        }
+        if ( right_origin ) flip_hor(row, src_width, 1);
+        int64_t dst_scln = bottom_origin ? height - 1 - src_scln : src_scln;
+        convert_row(row, &row[src_width + 1], &dst_array[dst_scln * out_line]);
+        int64_t src_done = ( src_scln + 1 ) * src_width;
+        if ( ( ctl_stop == GIA_TgaErr::Success ) and ( src_done >= ctl_next_pix ) and !band_done(src_done) ) result = ctl_stop; // остальные сканлинии переводятся уже чёрными
+    }
+    if ( ( result == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort;
+
+    delete [] row;
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недостающие и брошенные пиксели - непрозрачный чёрный
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    return result;
+}
+
+int64_t GIA_TgaDecoder::float_pix_size()
+{
+    switch(float_format)
+    {
+    case GIA_TgaFloatFormat::RGBA32F:
+        return 16;
+    case GIA_TgaFloatFormat::RGBA16F:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+void GIA_TgaDecoder::set_float_output(GIA_TgaFloatFormat format, bool linear)
+{
+    float_format = format;
+    float_linear = linear;
+}
+
+void GIA_TgaDecoder::set_square_pixels(bool enable)
+{
+    square_pixels = enable;
+}
+
+void GIA_TgaDecoder::convert_row_float(const uint32_t *src, uint8_t *dst, int64_t count)
+{
+    const srgb_luts &luts = srgb_tables();
+    auto src_bytes = (const uint8_t*)src;
+    const float *color_f = float_linear ? luts.linear_f : luts.unorm_f; // вся математика sRGB - в таблицах, по пикселям только выборки
+    if ( float_format == GIA_TgaFloatFormat::RGBA32F )
+    {
+        auto dst_f = (float*)dst;
+        for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx, src_bytes += 4, dst_f += 4)
+        {
+            float alpha = luts.unorm_f[src_bytes[3]];
+            float scale = pm_float ? alpha : 1.0f; // умножение на альфу в линейном свете
+            dst_f[0] = color_f[src_bytes[2]] * scale;
+            dst_f[1] = color_f[src_bytes[1]] * scale;
+            dst_f[2] = color_f[src_bytes[0]] * scale;
+            dst_f[3] = alpha;
+        }
+        return;
+    }
+    const uint16_t *color_h = float_linear ? luts.linear_h : luts.unorm_h;
+    auto dst_h = (uint16_t*)dst;
+    for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx, src_bytes += 4, dst_h += 4)
+    {
+        if ( pm_float and ( src_bytes[3] != 255 ) ) // полупрозрачный пиксель : произведение переводится в half отдельно
+        {
+            float alpha = luts.unorm_f[src_bytes[3]];
+            dst_h[0] = float_to_half(color_f[src_bytes[2]] * alpha);
+            dst_h[1] = float_to_half(color_f[src_bytes[1]] * alpha);
+            dst_h[2] = float_to_half(color_f[src_bytes[0]] * alpha);
+        }
+        else
+        {
+            dst_h[0] = color_h[src_bytes[2]];
+            dst_h[1] = color_h[src_bytes[1]];
+            dst_h[2] = color_h[src_bytes[0]];
+        }
+        dst_h[3] = luts.unorm_h[src_bytes[3]];
+    }
+}
+
+bool GIA_TgaDecoder::prepare_aspect()
+{
+    aspect_active = false;
+    aspect_width = width;
+    if ( !square_pixels ) return false;
+    extensions_area *aspect_ext = find_ext_area();
+    if ( ( aspect_ext == nullptr ) or ( aspect_ext->pix_numer == 0 ) or ( aspect_ext->pix_denom == 0 ) ) return false;
+    int64_t out_width = ( int64_t(width) * aspect_ext->pix_numer * 2 + aspect_ext->pix_denom ) / ( int64_t(aspect_ext->pix_denom) * 2 ); // ширина пикселя / высота пикселя = pix_numer / pix_denom
+    if ( out_width < 1 ) out_width = 1;
+    if ( out_width > 65535 ) out_width = 65535;
+    if ( out_width == width ) return false;
+
+    /// веса треугольного фильтра : при растяжении - линейная интерполяция, при сжатии фильтр расширяется на scale исходных пикселей
+    double scale = double(width) / out_width;
+    double radius = ( scale > 1.0 ) ? scale : 1.0;
+    int taps = 1;
+    for(int64_t dst_idx = 0; dst_idx < out_width; ++dst_idx)
+    {
+        double center = ( dst_idx + 0.5 ) * scale - 0.5;
+        int64_t lo = int64_t(std::floor(center - radius)) + 1;
+        int64_t hi = int64_t(std::ceil(center + radius)) - 1;
+        if ( lo < 0 ) lo = 0;
+        if ( hi > width - 1 ) hi = width - 1;
+        if ( hi - lo + 1 > taps ) taps = int(hi - lo + 1);
+    }
+    aspect_taps = ( taps + 1 ) & ~1; // веса берутся парами, лишний вес нулевой и приходится на запасной пиксель сканлинии
+    aspect_start.assign(out_width, 0);
+    aspect_weights.assign(out_width * aspect_taps, 0);
+    for(int64_t dst_idx = 0; dst_idx < out_width; ++dst_idx)
+    {
+        double center = ( dst_idx + 0.5 ) * scale - 0.5;
+        int64_t start = int64_t(std::floor(center - radius)) + 1;
+        if ( start > width - taps ) start = width - taps;
+        if ( start < 0 ) start = 0;
+        aspect_start[dst_idx] = int32_t(start);
+        auto tap_weight = [&](int tap) { double dist = std::fabs(start + tap - center) / radius; return ( dist < 1.0 ) ? 1.0 - dist : 0.0; };
+        double sum = 0.0;
+        for(int tap = 0; tap < taps; ++tap) sum += tap_weight(tap);
+        int16_t *weights = &aspect_weights[dst_idx * aspect_taps];
+        int total = 0, max_tap = 0;
+        for(int tap = 0; tap < taps; ++tap)
+        {
+            weights[tap] = int16_t(std::lround(tap_weight(tap) / sum * 16384.0));
+            total += weights[tap];
+            if ( weights[tap] > weights[max_tap] ) max_tap = tap;
+        }
+        weights[max_tap] += int16_t(16384 - total); // сумма окна точно 16384 : однотонная сканлиния остаётся однотонной
+    }
+    aspect_width = int(out_width);
+    aspect_active = true;
+    return true;
+}
+
+void GIA_TgaDecoder::resample_row(const uint32_t *src, uint32_t *dst)
+{
+    const int32_t *starts = aspect_start.data();
+    const int16_t *weights = aspect_weights.data();
+    int64_t dst_idx = 0;
+#ifdef GIA_TGA_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round_8192 = _mm_set1_epi32(8192);
+    for(; dst_idx + 2 <= aspect_width; dst_idx += 2) // по 2 выходных пикселя за итерацию
+    {
+        const uint32_t *window0 = &src[starts[dst_idx]];
+        const uint32_t *window1 = &src[starts[dst_idx + 1]];
+        const int16_t *weights0 = &weights[dst_idx * aspect_taps];
+        const int16_t *weights1 = weights0 + aspect_taps;
+        __m128i acc0 = round_8192;
+        __m128i acc1 = round_8192;
+        for(int tap = 0; tap < aspect_taps; tap += 2) // пара исходных пикселей на окно
+        {
+            __m128i pair0 = _mm_loadl_epi64((const __m128i*)&window0[tap]);
+            __m128i pair1 = _mm_loadl_epi64((const __m128i*)&window1[tap]);
+            pair0 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(pair0, _mm_srli_si128(pair0, 4)), zero); // b0 b1 g0 g1 r0 r1 a0 a1 в словах
+            pair1 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(pair1, _mm_srli_si128(pair1, 4)), zero);
+            int32_t weight_pair0, weight_pair1; // два соседних int16 - пара множителей для madd
+            memcpy(&weight_pair0, &weights0[tap], 4);
+            memcpy(&weight_pair1, &weights1[tap], 4);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(pair0, _mm_set1_epi32(weight_pair0)));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(pair1, _mm_set1_epi32(weight_pair1)));
+        }
+        acc0 = _mm_packs_epi32(_mm_srai_epi32(acc0, 14), _mm_srai_epi32(acc1, 14));
+        _mm_storel_epi64((__m128i*)&dst[dst_idx], _mm_packus_epi16(acc0, acc0));
+    }
+#endif
+    for(; dst_idx < aspect_width; ++dst_idx)
+    {
+        const uint32_t *window = &src[starts[dst_idx]];
+        const int16_t *window_weights = &weights[dst_idx * aspect_taps];
+        int32_t acc[4] = { 8192, 8192, 8192, 8192 }; // округление
+        for(int tap = 0; tap < aspect_taps; ++tap)
+        {
+            for(int chan = 0; chan < 4; ++chan) acc[chan] += int32_t( ( window[tap] >> ( chan * 8 ) ) & 0xFF ) * window_weights[tap];
+        }
+        uint32_t result = 0;
+        for(int chan = 0; chan < 4; ++chan)
+        {
+            int32_t value = acc[chan] >> 14;
+            if ( value < 0 ) value = 0;
+            if ( value > 255 ) value = 255;
+            result |= uint32_t(value) << ( chan * 8 );
+        }
+        dst[dst_idx] = result;
+    }
+}
+
+void GIA_TgaDecoder::convert_row(uint32_t *row, uint32_t *aspect_row, uint8_t *dst)
+{
+    bool is_float = float_format != GIA_TgaFloatFormat::None;
+    uint32_t *pixels = row;
+    if ( aspect_active )
+    {
+        pixels = is_float ? aspect_row : (uint32_t*)dst; // без float передискретизация пишет сразу на место
+        resample_row(row, pixels);
+    }
+    if ( is_float ) convert_row_float(pixels, dst, aspect_width);
+}
+
+int64_t GIA_TgaDecoder::bc_size(GIA_TgaBcFormat format)
+{
+    int64_t block_bytes = ( format == GIA_TgaBcFormat::BC1 ) ? 8 : 16;
+    return ( ( int64_t(width) + 3 ) >> 2 ) * ( ( int64_t(height) + 3 ) >> 2 ) * block_bytes;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, SmallBuffer, Cancelled, BudgetExceeded, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_bc(GIA_TgaBcFormat format)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+
+    release_dst();
+
+    prepare_pixel_ops(true);
+
+    int64_t blocks_x = ( int64_t(width) + 3 ) >> 2;
+    int64_t block_bytes = ( format == GIA_TgaBcFormat::BC1 ) ? 8 : 16;
+    int64_t band_width = blocks_x << 2; // сканлиния полосы, дополненная до границы блока
+    auto band = new (std::nothrow) uint32_t[band_width * 4]; // полоса из 4 сканлиний - вся несжатая память транскодирования
+    if ( band == nullptr ) return GIA_TgaErr::MemAllocErr;
+    int64_t alloc_size = bc_size(format);
+    GIA_TgaErr result = alloc_dst(alloc_size);
+    if ( result != GIA_TgaErr::Success )
+    {
+        delete [] band;
+        return result;
+    }
+    is_dst_compressed = true;
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        delete [] band;
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    /// сканлинии кладутся в полосу в нормальной ориентации; полоса сжимается, как только собран её ряд блоков
+    bool bottom_origin = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool right_origin = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    uint32_t block[16];
+    row_reader reader;
+    reader_start(reader);
+    for(int64_t src_scln = 0; src_scln < height; ++src_scln)
+    {
+        int64_t dst_scln = bottom_origin ? height - 1 - src_scln : src_scln;
+        uint32_t *band_row = &band[( dst_scln & 3 ) * band_width];
+        if ( result == GIA_TgaErr::Success )
+        {
+            result = read_pixels(reader, band_row, width);
+        }
+        else // после обрыва данных или остановки остаток изображения - непрозрачный чёрный, как в decode_region
+        {
+            for(int64_t pix_idx = 0; pix_idx < width; ++pix_idx) band_row[pix_idx] = 0xFF000000;
+        }
+        if ( right_origin ) flip_hor(band_row, width, 1);
+        for(int64_t pix_idx = width; pix_idx < band_width; ++pix_idx) band_row[pix_idx] = band_row[width - 1]; // поле до границы блока повторяет крайний пиксель
+        bool block_row_done = bottom_origin ? ( ( dst_scln & 3 ) == 0 ) : ( ( ( dst_scln & 3 ) == 3 ) or ( dst_scln == height - 1 ) );
+        if ( block_row_done )
+        {
+            int64_t block_row = dst_scln >> 2;
+            int64_t valid_rows = ( height - ( block_row << 2 ) < 4 ) ? height - ( block_row << 2 ) : 4;
+            for(int64_t row = valid_rows; row < 4; ++row) memcpy(&band[row * band_width], &band[( valid_rows - 1 ) * band_width], band_width * 4); // ниже края - повтор последней сканлинии
+            uint8_t *dst_block = &dst_array[block_row * blocks_x * block_bytes];
+            for(int64_t block_col = 0; block_col < blocks_x; ++block_col, dst_block += block_bytes)
+            {
+                for(int row = 0; row < 4; ++row) memcpy(&block[row << 2], &band[row * band_width + ( block_col << 2 )], 16);
+                encode_bc_block(block, format, dst_block);
+            }
+            if ( ctl_stop != GIA_TgaErr::Success ) // ряд блоков, на котором остановились, дособран из чёрных сканлиний, остальные ряды - копии одного чёрного блока
+            {
+                uint8_t black_block[16];
+                for(int pix_idx = 0; pix_idx < 16; ++pix_idx) block[pix_idx] = 0xFF000000;
+                encode_bc_block(block, format, black_block);
+                int64_t rest_rows = bottom_origin ? block_row : ( ( int64_t(height) + 3 ) >> 2 ) - block_row - 1; // при нижнем начале координат ряды идут снизу вверх
+                uint8_t *rest_block = bottom_origin ? dst_array : &dst_array[( block_row + 1 ) * blocks_x * block_bytes];
+                for(int64_t block_idx = 0; block_idx < rest_rows * blocks_x; ++block_idx, rest_block += block_bytes) memcpy(rest_block, black_block, block_bytes);
+                break;
+            }
+        }
+        int64_t src_done = ( src_scln + 1 ) * width;
+        if ( ( ctl_stop == GIA_TgaErr::Success ) and ( src_done >= ctl_next_pix ) and !band_done(src_done) ) result = ctl_stop;
+    }
+    if ( ( result == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort;
+
+    delete [] band;
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недостающие и брошенные пиксели - непрозрачный чёрный
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    return result;
+}
+
+// сжимает блок 4x4 (16 пикселей BB GG RR AA построчно) в 8 байтов BC1 или 16 байтов BC3
+void GIA_TgaDecoder::encode_bc_block(const uint32_t *block, GIA_TgaBcFormat format, uint8_t *dst)
+{
+    /// концы отрезка ищутся по ограничивающему параллелепипеду пикселей блока
+    uint8_t lo[4];
+    uint8_t hi[4];
+#ifdef GIA_TGA_SSE2
+    __m128i min4 = _mm_loadu_si128((const __m128i*)&block[0]); // сканлиния блока - ровно один регистр
+    __m128i max4 = min4;
+    for(int row = 1; row < 4; ++row)
+    {
+        __m128i row4 = _mm_loadu_si128((const __m128i*)&block[row << 2]);
+        min4 = _mm_min_epu8(min4, row4);
+        max4 = _mm_max_epu8(max4, row4);
+    }
+    /// свёртка 4 столбцов в один пиксель
+    min4 = _mm_min_epu8(min4, _mm_shuffle_epi32(min4, _MM_SHUFFLE(1, 0, 3, 2)));
+    max4 = _mm_max_epu8(max4, _mm_shuffle_epi32(max4, _MM_SHUFFLE(1, 0, 3, 2)));
+    min4 = _mm_min_epu8(min4, _mm_shuffle_epi32(min4, _MM_SHUFFLE(2, 3, 0, 1)));
+    max4 = _mm_max_epu8(max4, _mm_shuffle_epi32(max4, _MM_SHUFFLE(2, 3, 0, 1)));
+    uint32_t min_px = uint32_t(_mm_cvtsi128_si32(min4));
+    uint32_t max_px = uint32_t(_mm_cvtsi128_si32(max4));
+    memcpy(lo, &min_px, 4);
+    memcpy(hi, &max_px, 4);
+#else
+    for(int ch = 0; ch < 4; ++ch)
+    {
+        lo[ch] = 255;
+        hi[ch] = 0;
+    }
+    for(int pix_idx = 0; pix_idx < 16; ++pix_idx)
+    {
+        auto pix_bytes = (const uint8_t*)&block[pix_idx];
+        for(int ch = 0; ch < 4; ++ch)
+        {
+            if ( pix_bytes[ch] < lo[ch] ) lo[ch] = pix_bytes[ch];
+            if ( pix_bytes[ch] > hi[ch] ) hi[ch] = pix_bytes[ch];
+        }
+    }
+#endif
+    bool punch_alpha = ( format == GIA_TgaBcFormat::BC1 ) and ( lo[3] < 128 ); // есть прозрачные пиксели : 3-цветный режим BC1
+    if ( format == GIA_TgaBcFormat::BC3 )
+    {
+        encode_bc3_alpha(block, lo[3], hi[3], dst);
+        dst += 8;
+    }
+    if ( punch_alpha ) // прозрачные пиксели кодируются отдельным индексом, их цвет концы не сдвигает
+    {
+        for(int ch = 0; ch < 3; ++ch)
+        {
+            lo[ch] = 255;
+            hi[ch] = 0;
+        }
+        for(int pix_idx = 0; pix_idx < 16; ++pix_idx)
+        {
+            auto pix_bytes = (const uint8_t*)&block[pix_idx];
+            if ( pix_bytes[3] < 128 ) continue;
+            for(int ch = 0; ch < 3; ++ch)
+            {
+                if ( pix_bytes[ch] < lo[ch] ) lo[ch] = pix_bytes[ch];
+                if ( pix_bytes[ch] > hi[ch] ) hi[ch] = pix_bytes[ch];
+            }
+        }
+        if ( lo[0] > hi[0] ) // весь блок прозрачный
+        {
+            memset(dst, 0, 4);
+            memset(&dst[4], 0xFF, 4);
+            return;
+        }
+    }
+    /// диагональ параллелепипеда выбирается по знаку корреляции синего и красного каналов с зелёным
+    int cov_bg = 0;
+    int cov_rg = 0;
+    for(int pix_idx = 0; pix_idx < 16; ++pix_idx)
+    {
+        auto pix_bytes = (const uint8_t*)&block[pix_idx];
+        if ( punch_alpha and ( pix_bytes[3] < 128 ) ) continue;
+        int delta_g = 2 * pix_bytes[1] - lo[1] - hi[1];
+        cov_bg += ( 2 * pix_bytes[0] - lo[0] - hi[0] ) * delta_g;
+        cov_rg += ( 2 * pix_bytes[2] - lo[2] - hi[2] ) * delta_g;
+    }
+    int end_0[3] = { hi[0], hi[1], hi[2] };
+    int end_1[3] = { lo[0], lo[1], lo[2] };
+    if ( cov_bg < 0 ) std::swap(end_0[0], end_1[0]);
+    if ( cov_rg < 0 ) std::swap(end_0[2], end_1[2]);
+    for(int ch = 0; ch < 3; ++ch) // концы сдвигаются внутрь на 1/16 диапазона : меньше средняя ошибка
+    {
+        int inset = ( end_0[ch] - end_1[ch] ) / 16;
+        end_0[ch] -= inset;
+        end_1[ch] += inset;
+    }
+    auto to_565 = [](const int *bgr) { return uint16_t( ( ( bgr[2] * 31 + 127 ) / 255 ) << 11 | ( ( bgr[1] * 63 + 127 ) / 255 ) << 5 | ( ( bgr[0] * 31 + 127 ) / 255 ) ); };
+    uint16_t color_0 = to_565(end_0);
+    uint16_t color_1 = to_565(end_1);
+    if ( punch_alpha ? ( color_0 > color_1 ) : ( color_0 < color_1 ) ) std::swap(color_0, color_1); // порядок концов задаёт режим блока
+    bool three_colors = color_0 <= color_1; // так блок прочитает декодер
+    /// палитра в том виде, в каком её восстановит декодер
+    int palette[4][3];
+    for(int ch = 0; ch < 3; ++ch)
+    {
+        static const int shift[3] = { 0, 5, 11 };
+        static const int bits[3] = { 5, 6, 5 };
+        int value_0 = ( color_0 >> shift[ch] ) & ( ( 1 << bits[ch] ) - 1 );
+        int value_1 = ( color_1 >> shift[ch] ) & ( ( 1 << bits[ch] ) - 1 );
+        palette[0][ch] = ( value_0 << ( 8 - bits[ch] ) ) | ( value_0 >> ( 2 * bits[ch] - 8 ) );
+        palette[1][ch] = ( value_1 << ( 8 - bits[ch] ) ) | ( value_1 >> ( 2 * bits[ch] - 8 ) );
+    }
+    /// индекс - ближайшая к проекции пикселя на отрезок точка палитры
+    int dir[3] = { palette[1][0] - palette[0][0], palette[1][1] - palette[0][1], palette[1][2] - palette[0][2] };
+    int len2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+    static const uint32_t four_step_idx[4] = { 0, 2, 3, 1 }; // шаг вдоль отрезка -> индекс BC1
+    static const uint32_t three_step_idx[3] = { 0, 2, 1 };
+    int steps = three_colors ? 2 : 3;
+    uint32_t indices = 0;
+    for(int pix_idx = 15; pix_idx >= 0; --pix_idx)
+    {
+        auto pix_bytes = (const uint8_t*)&block[pix_idx];
+        indices <<= 2;
+        if ( punch_alpha and ( pix_bytes[3] < 128 ) )
+        {
+            indices |= 3;
+            continue;
+        }
+        if ( len2 == 0 ) continue;
+        int dot = ( pix_bytes[0] - palette[0][0] ) * dir[0] + ( pix_bytes[1] - palette[0][1] ) * dir[1] + ( pix_bytes[2] - palette[0][2] ) * dir[2];
+        int step = ( 2 * steps * dot + len2 ) / ( 2 * len2 );
+        if ( step < 0 ) step = 0;
+        if ( step > steps ) step = steps;
+        indices |= three_colors ? three_step_idx[step] : four_step_idx[step];
+    }
+    memcpy(&dst[0], &color_0, 2);
+    memcpy(&dst[2], &color_1, 2);
+    memcpy(&dst[4], &indices, 4);
+}
+
+// альфа-блок BC3 : 8-уровневая интерполяция между максимумом и минимумом альфы блока
+void GIA_TgaDecoder::encode_bc3_alpha(const uint32_t *block, uint8_t min_alpha, uint8_t max_alpha, uint8_t *dst)
+{
+    dst[0] = max_alpha;
+    dst[1] = min_alpha;
+    uint64_t indices = 0;
+    int range = max_alpha - min_alpha;
+    if ( range > 0 ) // иначе все индексы нулевые
+    {
+        for(int pix_idx = 15; pix_idx >= 0; --pix_idx)
+        {
+            int step = ( ( max_alpha - int(block[pix_idx] >> 24) ) * 14 + range ) / ( 2 * range ); // 0 - максимум, 7 - минимум
+            uint64_t alpha_idx = ( step == 0 ) ? 0 : ( step == 7 ) ? 1 : uint64_t(step + 1);
+            indices = ( indices << 3 ) | alpha_idx;
+        }
+    }
+    for(int b_idx = 0; b_idx < 6; ++b_idx) dst[2 + b_idx] = uint8_t(indices >> ( b_idx * 8 )); // 16 индексов по 3 бита
+}
+
+void GIA_TgaDecoder::reader_start(row_reader &reader)
+{
+    reader.src_idx = 0;
+    reader.src_end = src_size - pix_data_offset;
+    reader.packet_left = 0;
+    reader.is_rle_packet = false;
+    reader.rle_value = 0xFF000000;
+}
+
+// может возвращать ошибки : TruncDataAbort, Success
+// без индекса сканлинии до scln только разбираются, с индексом разбор начинается с ближайшей записи
+GIA_TgaErr GIA_TgaDecoder::reader_seek(row_reader &reader, int64_t scln, int64_t scln_width)
+{
+    reader_start(reader);
+    int64_t skip_rows = scln;
+    if ( !rle_index.empty() and ( scln >= rle_index_step ) )
+    {
+        int64_t entry_idx = scln / rle_index_step;
+        if ( entry_idx >= int64_t(rle_index.size()) ) entry_idx = rle_index.size() - 1;
+        const GIA_TgaRleIndexEntry &entry = rle_index[entry_idx];
+        reader.src_idx = int64_t(entry.src_idx);
+        if ( entry.packet_done > 0 ) // сканлиния начинается внутри пакета : пакет открывается и его начало пропускается
+        {
+            uint8_t *pix_array = &src_array[pix_data_offset];
+            reader.packet_left = (pix_array[reader.src_idx] & 0b01111111) + 1 - entry.packet_done;
+            reader.is_rle_packet = (pix_array[reader.src_idx] >> 7) == 1;
+            ++reader.src_idx;
+            if ( reader.is_rle_packet )
+            {
+                convert_pixels(&pix_array[reader.src_idx], &reader.rle_value, 1);
+                reader.src_idx += one_pix_size;
+            }
+            else
+            {
+                reader.src_idx += entry.packet_done * one_pix_size;
+            }
+        }
+        skip_rows = scln - entry_idx * rle_index_step;
+    }
+    return ( skip_rows > 0 ) ? read_pixels(reader, nullptr, skip_rows * scln_width) : GIA_TgaErr::Success;
+}
+
+void GIA_TgaDecoder::convert_pixels(const uint8_t *src, uint32_t *dst, int64_t count)
+{
+    switch(image_type)
+    {
+    case 1: // colormapped
+    case 9:
+    {
+        for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx)
+        {
+            dst[pix_idx] = color_map[src[pix_idx]].dword;
+        }
+        break;
+    }
+    case 3: // grayscale
+    case 11:
+    {
+        for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx)
+        {
+            dst[pix_idx] = 0xFF000000 | ( uint32_t(src[pix_idx]) * 0x00010101 );
+        }
+        break;
+    }
+    default: // truecolor
+    {
+        switch(one_pix_depth)
+        {
+        case 15:
+        case 16:
+        {
+            bbggrraa four_bytes;
+            uint8_t blue, green, red;
+            uint16_t word;
+            for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx)
+            {
+                word = uint16_t(src[pix_idx << 1] | ( src[(pix_idx << 1) + 1] << 8 ));
+                blue = (uint8_t) ( word & 0b00000000'00011111 );
+                green = (uint8_t) ( ( word >> 5 ) & 0b00000000'00011111 );
+                red = (uint8_t) ( ( word >> 10 ) & 0b00000000'00011111 );
+                four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
+                four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
+                four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
+                four_bytes.AA = ( ( one_pix_depth == 16 ) and ( (word & 0b10000000'00000000) == 0b10000000'00000000 ) ) ? 0 : 255;
+                dst[pix_idx] = four_bytes.dword;
+            }
+            break;
+        }
+        case 24:
+        {
+            bbggrraa four_bytes;
+            four_bytes.AA = 0xFF;
+            for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx)
+            {
+                four_bytes.BBGGRR = ((triplet*)src)[pix_idx];
+                dst[pix_idx] = four_bytes.dword;
+            }
+            break;
+        }
+        case 32:
+        {
+            memcpy(dst, src, count << 2);
+            break;
+        }
+        }
+    }
+    }
+    if ( pp_active and ( image_type != 1 ) and ( image_type != 9 ) ) process_pixels(dst, count, 0); // палитра уже обработана в create_cmap_256; статистику ведёт read_pixels
+}
+
+// может возвращать ошибки : TruncDataAbort, Success
+// при обрыве данных недостающие пиксели dst заполняются непрозрачным чёрным, как в decode
+GIA_TgaErr GIA_TgaDecoder::read_pixels(row_reader &reader, uint32_t *dst, int64_t count)
+{
+    uint8_t *pix_array = &src_array[pix_data_offset];
+    if ( image_type < 9 ) // без rle : пиксели идут подряд
+    {
+        int64_t avail_cnt = (reader.src_end - reader.src_idx) / one_pix_size;
+        int64_t read_cnt = ( avail_cnt < count ) ? avail_cnt : count;
+        if ( dst != nullptr ) convert_pixels(&pix_array[reader.src_idx], dst, read_cnt);
+        if ( stats_scan and ( dst != nullptr ) ) add_stats(dst, read_cnt, 1);
+        reader.src_idx += read_cnt * one_pix_size;
+        if ( read_cnt == count ) return GIA_TgaErr::Success;
+        if ( dst == nullptr ) return GIA_TgaErr::TruncDataAbort;
+        dst += read_cnt;
+        count -= read_cnt;
+        goto truncated;
+    }
+    int64_t take_cnt;
+    while ( count > 0 )
+    {
+        if ( reader.packet_left == 0 ) // начинается новый пакет
+        {
+            if ( reader.src_end - reader.src_idx < 1 ) goto truncated; // нехватка байтов на счётчик группы
+            reader.packet_left = (pix_array[reader.src_idx] & 0b01111111) + 1;
+            reader.is_rle_packet = (pix_array[reader.src_idx] >> 7) == 1;
+            ++reader.src_idx;
+            if ( reader.is_rle_packet )
+            {
+                if ( reader.src_end - reader.src_idx < one_pix_size ) { reader.packet_left = 0; goto truncated; } // нехватка байтов на пиксель группы
+                convert_pixels(&pix_array[reader.src_idx], &reader.rle_value, 1);
+                reader.src_idx += one_pix_size;
+            }
+            else
+            {
+                if ( reader.src_end - reader.src_idx < reader.packet_left * one_pix_size ) { reader.packet_left = 0; goto truncated; } // нехватка байтов на пиксели группы
+            }
+        }
+        take_cnt = ( reader.packet_left < count ) ? reader.packet_left : count; // пакет может продолжаться в следующей сканлинии
+        if ( dst == nullptr ) // пропуск : пакеты только разбираются
+        {
+            if ( !reader.is_rle_packet ) reader.src_idx += take_cnt * one_pix_size;
+        }
+        else if ( reader.is_rle_packet )
+        {
+            for(int64_t pix_idx = 0; pix_idx < take_cnt; ++pix_idx)
+            {
+                dst[pix_idx] = reader.rle_value;
+            }
+            if ( stats_scan ) add_stats(&reader.rle_value, 1, take_cnt); // значение rle-группы учитывается один раз с весом
+        }
+        else
+        {
+            convert_pixels(&pix_array[reader.src_idx], dst, take_cnt);
+            if ( stats_scan ) add_stats(dst, take_cnt, 1);
+            reader.src_idx += take_cnt * one_pix_size;
+        }
+        reader.packet_left -= take_cnt;
+        if ( dst != nullptr ) dst += take_cnt;
+        count -= take_cnt;
+    }
+    return GIA_TgaErr::Success;
+
+truncated:
+    if ( dst == nullptr ) return GIA_TgaErr::TruncDataAbort;
+    for(int64_t pix_idx = 0; pix_idx < count; ++pix_idx)
+    {
+        dst[pix_idx] = 0xFF000000;
+    }
+    return GIA_TgaErr::TruncDataAbort;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_scaled(uint8_t factor)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    if ( factor < 2 ) return decode(); // уменьшать нечего
+
+    release_dst();
+
+    prepare_pixel_ops(true);
+
+    /// с этого момента width/height и размеры описывают уменьшенное изображение, исходные размеры остаются в заголовке
+    uint16_t src_width = width;
+    uint16_t src_height = height;
+    width = (src_width + factor - 1) / factor; // неполные блоки у правого и нижнего краёв усредняются по фактическому числу пикселей
+    height = (src_height + factor - 1) / factor;
+    bytes_per_line = width * 4;
+    total_size_p = int64_t(width) * height;
+    total_size_b = total_size_p * 4;
+
+    int64_t alloc_size = total_size_b;
+    if ( mip_filter != GIA_TgaMipFilter::None ) alloc_size += mip_chain_size();
+
+    GIA_TgaErr alloc_result = alloc_dst(alloc_size);
+    if ( alloc_result != GIA_TgaErr::Success )
+    {
+        reset_dims();
+        return alloc_result;
+    }
+    auto src_row = new (std::nothrow) uint32_t[src_width]; // одна исходная сканлиния
+    auto acc_row = new (std::nothrow) uint32_t[width * 4]; // суммы каналов по блокам текущей полосы
+    if ( ( src_row == nullptr ) or ( acc_row == nullptr ) )
+    {
+        delete [] src_row;
+        delete [] acc_row;
+        reset_dims();
+        return GIA_TgaErr::MemAllocErr;
+    }
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        delete [] src_row;
+        delete [] acc_row;
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    row_reader reader;
+    reader_start(reader);
+    GIA_TgaErr result = GIA_TgaErr::Success;
+    for(int64_t dst_scln = 0; dst_scln < height; ++dst_scln)
+    {
+        memset(acc_row, 0, width * 4 * sizeof(uint32_t));
+        int64_t block_rows = src_height - dst_scln * factor;
+        if ( block_rows > factor ) block_rows = factor;
+        for(int64_t row_idx = 0; row_idx < block_rows; ++row_idx)
+        {
+            if ( result == GIA_TgaErr::Success )
+            {
+                result = read_pixels(reader, src_row, src_width);
+            }
+            else // после обрыва данных остаток изображения - непрозрачный чёрный, как в decode
+            {
+                for(int64_t src_x = 0; src_x < src_width; ++src_x) src_row[src_x] = 0xFF000000;
+            }
+            /// накопление сумм каналов по блокам
+            auto src_b_row = (uint8_t*)src_row;
+            for(int64_t src_x = 0; src_x < src_width; ++src_x)
+            {
+                uint32_t *acc = &acc_row[(src_x / factor) << 2];
+                acc[0] += src_b_row[(src_x << 2)];
+                acc[1] += src_b_row[(src_x << 2) + 1];
+                acc[2] += src_b_row[(src_x << 2) + 2];
+                acc[3] += src_b_row[(src_x << 2) + 3];
+            }
+        }
+        /// усреднение накопленной полосы в сканлинию результата
+        uint8_t *dst_row = &dst_array[dst_scln * bytes_per_line];
+        for(int64_t dst_x = 0; dst_x < width; ++dst_x)
+        {
+            int64_t block_cols = src_width - dst_x * factor;
+            if ( block_cols > factor ) block_cols = factor;
+            uint32_t block_size = uint32_t(block_cols * block_rows);
+            for(int ch = 0; ch < 4; ++ch)
+            {
+                dst_row[(dst_x << 2) + ch] = uint8_t( ( acc_row[(dst_x << 2) + ch] + block_size / 2 ) / block_size );
+            }
+        }
+        int64_t src_done = ( dst_scln * factor + block_rows ) * src_width; // исходные пиксели, прочитанные к концу полосы
+        if ( ( src_done >= ctl_next_pix ) and !band_done(src_done) )
+        {
+            auto rest = (uint32_t*)&dst_array[( dst_scln + 1 ) * bytes_per_line];
+            int64_t rest_pix = ( height - dst_scln - 1 ) * width;
+            for(int64_t pix_idx = 0; pix_idx < rest_pix; ++pix_idx) rest[pix_idx] = 0xFF000000; // брошенный остаток - непрозрачный чёрный, как в decode
+            result = ctl_stop;
+            break;
+        }
+    }
+    if ( ( result == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort; // rle-пакет вылез за пределы изображения
+
+    delete [] src_row;
+    delete [] acc_row;
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недостающие и брошенные пиксели - непрозрачный чёрный
+    if ( alpha_lo < alpha_hi ) alpha_partial = true; // усреднение блоков с разной альфой даёт промежуточные значения
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    if ( ( mip_filter != GIA_TgaMipFilter::None ) and ( ctl_stop == GIA_TgaErr::Success ) ) build_mipmaps(); // прерванное декодирование цепочку не строит
+
+    return result;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, SmallBuffer, InvalidRegion, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_region(int x, int y, int region_width, int region_height)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    if ( ( x < 0 ) or ( y < 0 ) or ( region_width <= 0 ) or ( region_height <= 0 ) or ( x + region_width > width ) or ( y + region_height > height ) ) return GIA_TgaErr::InvalidRegion;
+
+    release_dst();
+
+    prepare_pixel_ops(true);
+
+    /// область задаётся в координатах нормально ориентированного изображения, а в файле сканлинии и пиксели могут идти в обратном порядке
+    bool bottom_origin = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool right_origin = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    uint16_t src_width = width;
+    uint16_t src_height = height;
+    int64_t first_scln = bottom_origin ? src_height - ( y + region_height ) : y; // первая нужная сканлиния в порядке файла
+    int64_t skip_left = right_origin ? src_width - ( x + region_width ) : x; // пиксели сканлинии до области в порядке файла
+    int64_t skip_right = src_width - skip_left - region_width;
+
+    /// с этого момента width/height описывают область; она остаётся в порядке файла, flip ориентирует её как обычно
+    width = region_width;
+    height = region_height;
+    bytes_per_line = width * 4;
+    total_size_p = int64_t(width) * height;
+    total_size_b = total_size_p * 4;
+
+    int64_t alloc_size = total_size_b;
+    if ( mip_filter != GIA_TgaMipFilter::None ) alloc_size += mip_chain_size();
+
+    GIA_TgaErr result = alloc_dst(alloc_size);
+    if ( result != GIA_TgaErr::Success )
+    {
+        reset_dims();
+        return result;
+    }
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    row_reader reader;
+    result = reader_seek(reader, first_scln, src_width); // сканлинии до области не раскодируются
+    for(int64_t dst_scln = 0; dst_scln < height; ++dst_scln)
+    {
+        auto dst_row = (uint32_t*)&dst_array[dst_scln * bytes_per_line];
+        if ( result == GIA_TgaErr::Success ) result = read_pixels(reader, nullptr, skip_left);
+        if ( result == GIA_TgaErr::Success )
+        {
+            result = read_pixels(reader, dst_row, width); // пиксели области раскодируются сразу на место
+            if ( result == GIA_TgaErr::Success ) result = read_pixels(reader, nullptr, skip_right);
+        }
+        else // после обрыва данных остаток области - непрозрачный чёрный, как в decode_scaled
+        {
+            for(int64_t pix_idx = 0; pix_idx < width; ++pix_idx) dst_row[pix_idx] = 0xFF000000;
+        }
+        int64_t src_done = ( first_scln + dst_scln + 1 ) * src_width; // исходные пиксели, пройденные к концу сканлинии
+        if ( ( src_done >= ctl_next_pix ) and !band_done(src_done) )
+        {
+            auto rest = (uint32_t*)&dst_array[( dst_scln + 1 ) * bytes_per_line];
+            int64_t rest_pix = ( height - dst_scln - 1 ) * width;
+            for(int64_t pix_idx = 0; pix_idx < rest_pix; ++pix_idx) rest[pix_idx] = 0xFF000000; // брошенный остаток - непрозрачный чёрный, как в decode
+            result = ctl_stop;
+            break;
+        }
+    }
+    /// сканлинии после области не читаются вовсе, поэтому лишние пиксели обнаруживаются только у области, доходящей до конца данных
+    if ( ( result == GIA_TgaErr::Success ) and ( first_scln + height == src_height ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort;
+
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( ( result == GIA_TgaErr::TruncDataAbort ) or ( ctl_stop != GIA_TgaErr::Success ) ) alpha_hi = 255; // недостающие и брошенные пиксели - непрозрачный чёрный
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    if ( ( mip_filter != GIA_TgaMipFilter::None ) and ( ctl_stop == GIA_TgaErr::Success ) ) build_mipmaps(); // прерванное декодирование цепочку не строит
+
+    return result;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, Cancelled, BudgetExceeded, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_rows(GIA_TgaRowSink sink, int band_rows)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    if ( band_rows < 1 ) band_rows = 1;
+    if ( band_rows > height ) band_rows = height;
+
+    release_dst(); // полноразмерного массива нет : data() вернёт nullptr
+    is_dst_external = false;
+    mip_chain.clear();
+
+    bool is_float = float_format != GIA_TgaFloatFormat::None;
+    prepare_pixel_ops(true, is_float);
+    bool per_row = prepare_aspect() or is_float; // сканлиния переводится по одной, а не полосой
+
+    int64_t src_width = width;
+    int64_t out_line = int64_t(aspect_width) * float_pix_size();
+    auto band = new (std::nothrow) uint8_t[int64_t(band_rows) * out_line]; // единственный буфер пикселей, переиспользуется всеми полосами
+    auto row = per_row ? new (std::nothrow) uint32_t[src_width + 1 + aspect_width] : nullptr; // 8-битная сканлиния (с запасным пикселем для пар весов) и её передискретизация
+    if ( ( band == nullptr ) or ( per_row and ( row == nullptr ) ) )
+    {
+        delete [] band;
+        delete [] row;
+        return GIA_TgaErr::MemAllocErr;
+    }
+    if ( per_row ) row[src_width] = 0;
+    width = aspect_width; // с этого момента размеры описывают выдаваемые сканлинии
+    bytes_per_line = out_line; // как в decode_converted : для float/half сканлиния шире width * 4
+    total_size_p = int64_t(width) * height;
+    total_size_b = out_line * height;
+    if ( ( ( image_type == 1 ) or ( image_type == 9 ) ) and ( create_cmap_256() == GIA_TgaErr::MemAllocErr ) )
+    {
+        delete [] band;
+        delete [] row;
+        state = FSM_States::NotEnoughMem;
+        return GIA_TgaErr::MemAllocErr;
+    }
+
+    /// полосы идут в порядке файла, а внутри полосы сканлинии и пиксели сразу раскладываются в нормальной ориентации
+    bool bottom_origin = ( origin == GIA_TgaOrigin::BottomLeft ) or ( origin == GIA_TgaOrigin::BottomRight );
+    bool right_origin = ( origin == GIA_TgaOrigin::TopRight ) or ( origin == GIA_TgaOrigin::BottomRight );
+    row_reader reader;
+    reader_start(reader);
+    GIA_TgaErr result = GIA_TgaErr::Success;
+    for(int64_t band_start = 0; band_start < height; band_start += band_rows) // band_start - первая сканлиния полосы в порядке файла
+    {
+        int64_t band_height = ( band_start + band_rows < height ) ? band_rows : height - band_start;
+        for(int64_t band_scln = 0; band_scln < band_height; ++band_scln)
+        {
+            uint8_t *band_row = &band[( bottom_origin ? band_height - 1 - band_scln : band_scln ) * out_line];
+            uint32_t *dst_row = per_row ? row : (uint32_t*)band_row;
+            if ( result == GIA_TgaErr::Success )
+            {
+                result = read_pixels(reader, dst_row, src_width);
+            }
+            else // после обрыва данных остаток изображения - непрозрачный чёрный, как в decode_region
+            {
+                for(int64_t pix_idx = 0; pix_idx < src_width; ++pix_idx) dst_row[pix_idx] = 0xFF000000;
+            }
+            if ( per_row )
+            {
+                if ( right_origin ) flip_hor(row, src_width, 1);
+                convert_row(row, &row[src_width + 1], band_row);
+            }
+            int64_t src_done = ( band_start + band_scln + 1 ) * src_width;
+            if ( ( src_done >= ctl_next_pix ) and !band_done(src_done) ) break;
+        }
+        if ( ctl_stop != GIA_TgaErr::Success ) // недособранная полоса потребителю не передаётся
+        {
+            result = ctl_stop;
+            break;
+        }
+        if ( right_origin and !per_row ) flip_hor((uint32_t*)band, width, band_height);
+        int64_t first_row = bottom_origin ? height - band_start - band_height : band_start; // верхняя сканлиния полосы в нормальной ориентации
+        if ( !sink(int(first_row), int(band_height), band, out_line) )
+        {
+            ctl_stop = GIA_TgaErr::Cancelled;
+            result = ctl_stop;
+            break;
+        }
+    }
+    if ( ( result == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) result = GIA_TgaErr::TooMuchPixAbort;
+
+    delete [] band;
+    delete [] row;
+    if ( ( image_type == 1 ) or ( image_type == 9 ) ) delete [] color_map;
+    state = ( result == GIA_TgaErr::Success ) ? FSM_States::DecodedOK : FSM_States::DecodingAbort;
+    if ( result == GIA_TgaErr::TruncDataAbort ) alpha_hi = 255; // недостающие пиксели - непрозрачный чёрный
+    if ( ( ctl_stop == GIA_TgaErr::Success ) and progress_cb ) progress_cb(ctl_height, ctl_height);
+
+    return result;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, FileIOErr, Cancelled, BudgetExceeded, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_to_file(const string &path, int band_rows)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    ofstream file(path, ios::binary | ios::trunc);
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    bool write_ok = true;
+    GIA_TgaErr result = decode_rows([&](int first_row, int row_count, const uint8_t *pixels, int64_t line_size)
+    {
+        file.seekp(int64_t(first_row) * line_size); // при нижнем начале координат полосы приходят от конца файла к началу
+        file.write((const char*)pixels, int64_t(row_count) * line_size);
+        write_ok = bool(file);
+        return write_ok;
+    }, band_rows);
+    file.close();
+    if ( !write_ok or file.fail() ) return GIA_TgaErr::FileIOErr;
+    return result;
+}
+
+int64_t GIA_TgaDecoder::decode_size()
+{
+    if ( prepare_aspect() or ( float_format != GIA_TgaFloatFormat::None ) ) return int64_t(aspect_width) * float_pix_size() * height;
+    if ( layout != GIA_TgaLayout::Linear ) return tile_info().total_size;
+    return total_size_b + ( ( mip_filter != GIA_TgaMipFilter::None ) ? mip_chain_size() : 0 );
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, MemAllocErr, FileIOErr, Cancelled, BudgetExceeded, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::decode_to_shm(GIA_TgaShmImage &image, bool seal)
+{
+    image = GIA_TgaShmImage{-1, 0, 0, 0, 0, GIA_TgaLayout::Linear, 0, GIA_TgaFloatFormat::None, false, false};
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+#ifdef GIA_TGA_POSIX
+    int64_t size = decode_size();
+    int fd = -1;
+#ifdef GIA_TGA_MEMFD
+    fd = memfd_create("gia_tga", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+    if ( fd < 0 ) // без memfd : объект shm_open сразу удаляется из пространства имён, остаётся только дескриптор
+    {
+        static std::atomic<uint32_t> shm_counter{0};
+        char shm_name[64];
+        snprintf(shm_name, sizeof(shm_name), "/gia_tga_%d_%u", int(getpid()), unsigned(shm_counter.fetch_add(1)));
+        fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if ( fd >= 0 ) shm_unlink(shm_name);
+    }
+    if ( fd < 0 ) return GIA_TgaErr::FileIOErr;
+    void *map = ( ftruncate(fd, size) == 0 ) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if ( map == MAP_FAILED )
+    {
+        close(fd);
+        return GIA_TgaErr::FileIOErr;
+    }
+
+    /// decode пишет прямо в разделяемую память, как в буфер вызывающего
+    set_dst_buffer((uint8_t*)map, size);
+    GIA_TgaErr result = decode();
+    bool has_image = ( dst_array == (uint8_t*)map ) and ( result != GIA_TgaErr::MemAllocErr );
+    if ( has_image ) flip(); // потребитель получает изображение сразу в ориентации TopLeft
+    if ( dst_array == (uint8_t*)map )
+    {
+        dst_array = nullptr; // изображение принадлежит дескриптору : data() вернёт nullptr
+        is_data_detached = false;
+        is_dst_external = false;
+    }
+    set_dst_buffer(nullptr, 0);
+    munmap(map, size); // F_SEAL_WRITE не ставится, пока есть записываемые отображения
+    if ( !has_image )
+    {
+        close(fd);
+        return result;
+    }
+
+    image.fd = fd;
+    image.size = size;
+    image.width = width;
+    image.height = height;
+    image.bytes_per_line = bytes_per_line;
+    image.layout = is_dst_tiled ? layout : GIA_TgaLayout::Linear;
+    image.tile_size = is_dst_tiled ? tile_info().tile_size : 0;
+    image.float_format = is_dst_converted ? float_format : GIA_TgaFloatFormat::None;
+    image.premultiplied = premultiply;
+#ifdef GIA_TGA_MEMFD
+    image.sealed = seal and ( fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0 );
+#else
+    (void)seal;
+#endif
+    return result;
+#else
+    (void)seal;
+    return GIA_TgaErr::FileIOErr;
+#endif
+}
+
+// может возвращать ошибки : Success, MemAllocErr, TruncDataAbort, TooMuchPixAbort, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::recompress_rle(vector<uint8_t> &result)
+{
+    result.clear();
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+
+    int64_t pix_size = one_pix_size;
+    int64_t scln_bytes = int64_t(width) * pix_size;
+    int64_t packed_max = scln_bytes + ( width + 127 ) / 128; // худший случай : одни raw-пакеты
+    auto scln = new (std::nothrow) uint8_t[scln_bytes + packed_max]; // сырые пиксели сканлинии в исходном формате, за ними - её пакеты
+    auto best = new (std::nothrow) int64_t[( width + 1 ) * 3]; // best[i] - наименьший размер пакетов для первых i пикселей
+    auto scln_offsets = new (std::nothrow) int64_t[height]; // начала сканлиний в новых пиксельных данных (для таблицы сканлиний)
+    if ( ( scln == nullptr ) or ( best == nullptr ) or ( scln_offsets == nullptr ) )
+    {
+        delete [] scln;
+        delete [] best;
+        delete [] scln_offsets;
+        return GIA_TgaErr::MemAllocErr;
+    }
+    uint8_t *packed = &scln[scln_bytes];
+    int64_t *from = &best[width + 1]; // начало последнего пакета оптимального разбиения (у run-пакета - со знаком минус)
+    int64_t *raw_window = &best[( width + 1 ) * 2]; // кандидаты начала raw-пакета по возрастанию best[i] - i * pix_size
+    auto same_pix = [&](int64_t lpix_idx, int64_t rpix_idx) { return memcmp(&scln[lpix_idx * pix_size], &scln[rpix_idx * pix_size], pix_size) == 0; };
+
+    uint8_t *pix_array = &src_array[pix_data_offset];
+    row_reader reader; // здесь - только разбор пакетов исходника, пиксели не переводятся
+    reader_start(reader);
+    int64_t rle_idx = 0; // байтовый индекс пикселя текущего rle-пакета
+    GIA_TgaErr err = GIA_TgaErr::Success;
+    result.insert(result.end(), src_array, &src_array[pix_data_offset]); // заголовок, поле id и палитра - без изменений
+    for(int64_t scln_idx = 0; ( scln_idx < height ) and ( err == GIA_TgaErr::Success ); ++scln_idx)
+    {
+        /// 1. сырые пиксели сканлинии : пакеты исходника могут переходить через границу сканлинии
+        for(int64_t pix_idx = 0; pix_idx < width; )
+        {
+            if ( image_type < 9 )
+            {
+                if ( reader.src_end - reader.src_idx < scln_bytes ) { err = GIA_TgaErr::TruncDataAbort; break; }
+                memcpy(scln, &pix_array[reader.src_idx], scln_bytes);
+                reader.src_idx += scln_bytes;
+                break;
+            }
+            if ( reader.packet_left == 0 )
+            {
+                if ( reader.src_end - reader.src_idx < 1 ) { err = GIA_TgaErr::TruncDataAbort; break; }
+                reader.packet_left = (pix_array[reader.src_idx] & 0b01111111) + 1;
+                reader.is_rle_packet = (pix_array[reader.src_idx] >> 7) == 1;
+                ++reader.src_idx;
+                int64_t need_bytes = reader.is_rle_packet ? pix_size : reader.packet_left * pix_size;
+                if ( reader.src_end - reader.src_idx < need_bytes ) { err = GIA_TgaErr::TruncDataAbort; break; }
+                if ( reader.is_rle_packet )
+                {
+                    rle_idx = reader.src_idx;
+                    reader.src_idx += pix_size;
+                }
+            }
+            int64_t take_cnt = ( reader.packet_left < width - pix_idx ) ? reader.packet_left : width - pix_idx;
+            if ( reader.is_rle_packet )
+            {
+                for(int64_t take_idx = 0; take_idx < take_cnt; ++take_idx) memcpy(&scln[( pix_idx + take_idx ) * pix_size], &pix_array[rle_idx], pix_size);
+            }
+            else
+            {
+                memcpy(&scln[pix_idx * pix_size], &pix_array[reader.src_idx], take_cnt * pix_size);
+                reader.src_idx += take_cnt * pix_size;
+            }
+            reader.packet_left -= take_cnt;
+            pix_idx += take_cnt;
+        }
+        if ( err != GIA_TgaErr::Success ) break;
+
+        /// 2. оптимальное разбиение сканлинии на пакеты (пакеты не переходят через границу сканлинии, как требует TGA 2.0)
+        ///    raw-пакет [i, j) стоит 1 + (j - i) * pix_size, run-пакет - 1 + pix_size; best[] не убывает,
+        ///    поэтому лучший run-пакет начинается как можно раньше, а лучший raw-пакет ищется скользящим минимумом
+        best[0] = 0;
+        int64_t run_start = 0; // начало серии одинаковых пикселей, которой принадлежит пиксель j - 1
+        int64_t window_head = 0;
+        int64_t window_tail = 0;
+        for(int64_t end_idx = 1; end_idx <= width; ++end_idx)
+        {
+            int64_t last_idx = end_idx - 1;
+            if ( ( last_idx > 0 ) and !same_pix(last_idx, last_idx - 1) ) run_start = last_idx;
+            while ( ( window_tail > window_head ) and ( best[raw_window[window_tail - 1]] - raw_window[window_tail - 1] * pix_size >= best[last_idx] - last_idx * pix_size ) ) --window_tail;
+            raw_window[window_tail++] = last_idx;
+            while ( raw_window[window_head] < end_idx - 128 ) ++window_head; // raw-пакет не длиннее 128 пикселей
+            int64_t raw_from = raw_window[window_head];
+            int64_t run_from = ( run_start > end_idx - 128 ) ? run_start : end_idx - 128;
+            int64_t raw_cost = best[raw_from] + 1 + ( end_idx - raw_from ) * pix_size;
+            int64_t run_cost = best[run_from] + 1 + pix_size;
+            best[end_idx] = ( run_cost <= raw_cost ) ? run_cost : raw_cost;
+            from[end_idx] = ( run_cost <= raw_cost ) ? -run_from - 1 : raw_from;
+        }
+
+        /// 3. пакеты собираются с конца сканлинии, затем дописываются к результату
+        int64_t packed_idx = packed_max;
+        for(int64_t end_idx = width; end_idx > 0; )
+        {
+            bool is_run = from[end_idx] < 0;
+            int64_t start_idx = is_run ? -from[end_idx] - 1 : from[end_idx];
+            int64_t pix_cnt = end_idx - start_idx;
+            int64_t data_bytes = is_run ? pix_size : pix_cnt * pix_size;
+            packed_idx -= data_bytes;
+            memcpy(&packed[packed_idx], &scln[start_idx * pix_size], data_bytes);
+            packed[--packed_idx] = uint8_t( ( is_run ? 0b10000000 : 0 ) | ( pix_cnt - 1 ) );
+            end_idx = start_idx;
+        }
+        scln_offsets[scln_idx] = int64_t(result.size());
+        result.insert(result.end(), &packed[packed_idx], &packed[packed_max]);
+    }
+    if ( ( err == GIA_TgaErr::Success ) and ( reader.packet_left > 0 ) ) err = GIA_TgaErr::TooMuchPixAbort;
+    delete [] scln;
+    delete [] best;
+    if ( err != GIA_TgaErr::Success )
+    {
+        delete [] scln_offsets;
+        result.clear();
+        return err;
+    }
+
+    /// всё, что шло за пиксельными данными (область разработчика, область расширений, миниатюра, футер), копируется как есть
+    int64_t pix_end = pix_data_offset + reader.src_idx;
+    int64_t delta = int64_t(result.size()) - pix_end; // сдвиг всех смещений, указывающих за пиксельные данные
+    result.insert(result.end(), &src_array[pix_end], &src_array[src_size]);
+    uint8_t *dst = result.data();
+    ((GIA_TgaHeader*)dst)->img_type = ( image_type < 9 ) ? image_type + 8 : image_type; // 1, 2, 3 -> 9, 10, 11
+    auto shift_offset = [&](uint32_t &offset) { if ( ( offset != 0 ) and ( offset >= pix_end ) ) offset = uint32_t(offset + delta); };
+    extensions_area *src_ext = find_ext_area();
+    if ( ( int64_t(src_size) - int64_t(sizeof(footer)) >= pix_end ) and ( memcmp(&(((footer*)&src_array[src_size - sizeof(footer)])->signature), "TRUEVISION-XFILE\x2E\x00", 18) == 0 ) )
+    {
+        footer ftr;
+        memcpy(&ftr, &dst[result.size() - sizeof(footer)], sizeof(footer));
+        shift_offset(ftr.ext_offset);
+        shift_offset(ftr.dev_offset);
+        memcpy(&dst[result.size() - sizeof(footer)], &ftr, sizeof(footer));
+        /// каталог области разработчика : число тегов (2 байта), затем теги по 10 байтов - номер, смещение данных, размер
+        if ( ( ftr.dev_offset != 0 ) and ( ftr.dev_offset >= pix_end + delta ) and ( int64_t(result.size()) - ftr.dev_offset >= 2 ) )
+        {
+            uint16_t tag_cnt;
+            memcpy(&tag_cnt, &dst[ftr.dev_offset], 2);
+            int64_t tag_pos = int64_t(ftr.dev_offset) + 2;
+            for(uint16_t tag_idx = 0; ( tag_idx < tag_cnt ) and ( int64_t(result.size()) - tag_pos >= 10 ); ++tag_idx)
+            {
+                uint32_t tag_offset;
+                memcpy(&tag_offset, &dst[tag_pos + 2], 4);
+                shift_offset(tag_offset);
+                memcpy(&dst[tag_pos + 2], &tag_offset, 4);
+                tag_pos += 10;
+            }
+        }
+    }
+    if ( ( src_ext != nullptr ) and ( (uint8_t*)src_ext >= &src_array[pix_end] ) )
+    {
+        int64_t ext_pos = ( (uint8_t*)src_ext - src_array ) + delta;
+        extensions_area ext;
+        memcpy(&ext, &dst[ext_pos], sizeof(extensions_area));
+        shift_offset(ext.color_offset);
+        shift_offset(ext.stamp_offset);
+        shift_offset(ext.scan_offset);
+        memcpy(&dst[ext_pos], &ext, sizeof(extensions_area));
+        /// таблица сканлиний хранит смещения начал сканлиний в файле : пересчитывается по новым пакетам
+        if ( ( ext.scan_offset != 0 ) and ( ext.scan_offset >= pix_end + delta ) and ( int64_t(result.size()) - ext.scan_offset >= int64_t(height) * 4 ) )
+        {
+            for(int64_t scln_idx = 0; scln_idx < height; ++scln_idx)
+            {
+                uint32_t scln_offset = uint32_t(scln_offsets[scln_idx]);
+                memcpy(&dst[ext.scan_offset + scln_idx * 4], &scln_offset, 4);
+            }
+        }
+    }
+    delete [] scln_offsets;
+    return GIA_TgaErr::Success;
+}
+
+// может возвращать ошибки : TruncDataAbort, TooMuchPixAbort, Success, InvalidIndex, NeedHeaderValidation
+// при обрыве данных индекс охватывает сканлинии до места обрыва
+GIA_TgaErr GIA_TgaDecoder::build_rle_index(vector<uint8_t> &index, int rows_step)
+{
+    index.clear();
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    if ( image_type < 9 ) return GIA_TgaErr::InvalidIndex; // без rle начало любой сканлинии вычисляется сразу, индекс не нужен
+    if ( rows_step < 1 ) rows_step = 1;
+
+    /// один проход только по заголовкам пакетов (пиксели не переводятся), запоминается пакет, в котором начинается каждая rows_step-я сканлиния
+    uint8_t *pix_array = &src_array[pix_data_offset];
+    int64_t src_end = src_size - pix_data_offset;
+    int64_t step_pix = int64_t(rows_step) * width; // пикселей между соседними записями
+    int64_t total_pix = int64_t(width) * height;
+    int64_t next_entry_pix = 0; // номер пикселя, с которого начинается сканлиния следующей записи
+    int64_t pix_idx = 0; // номер первого пикселя текущего пакета
+    int64_t src_idx = 0;
+    rle_index.clear();
+    rle_index_step = rows_step;
+    GIA_TgaErr result = GIA_TgaErr::Success;
+    while ( pix_idx < total_pix )
+    {
+        if ( pix_idx == next_entry_pix ) // сканлиния начинается с нового пакета
+        {
+            rle_index.push_back(GIA_TgaRleIndexEntry { uint64_t(src_idx), 0 });
+            next_entry_pix += step_pix;
+        }
+        if ( src_end - src_idx < 1 ) { result = GIA_TgaErr::TruncDataAbort; break; } // нехватка байтов на счётчик группы
+        int64_t packet_len = (pix_array[src_idx] & 0b01111111) + 1;
+        int64_t packet_bytes = 1 + ( ( (pix_array[src_idx] >> 7) == 1 ) ? 1 : packet_len ) * one_pix_size;
+        if ( src_end - src_idx < packet_bytes ) { result = GIA_TgaErr::TruncDataAbort; break; } // нехватка байтов на пиксели группы
+        for(; ( next_entry_pix < pix_idx + packet_len ) and ( next_entry_pix < total_pix ); next_entry_pix += step_pix) // сканлиния начинается внутри пакета
+        {
+            rle_index.push_back(GIA_TgaRleIndexEntry { uint64_t(src_idx), uint8_t(next_entry_pix - pix_idx) });
+        }
+        pix_idx += packet_len;
+        src_idx += packet_bytes;
+    }
+    if ( pix_idx > total_pix ) result = GIA_TgaErr::TooMuchPixAbort; // rle-пакет вылез за пределы изображения
+
+    GIA_TgaRleIndexHeader index_header;
+    memcpy(index_header.magic, "GIATRI1\x00", 8);
+    index_header.header = *header;
+    index_header.pix_data_size = uint64_t(src_size - pix_data_offset);
+    index_header.rows_step = uint32_t(rows_step);
+    index_header.entry_count = uint32_t(rle_index.size());
+    index.resize(sizeof(index_header) + rle_index.size() * sizeof(GIA_TgaRleIndexEntry));
+    memcpy(index.data(), &index_header, sizeof(index_header));
+    memcpy(&index[sizeof(index_header)], rle_index.data(), rle_index.size() * sizeof(GIA_TgaRleIndexEntry));
+    return result;
+}
+
+// может возвращать ошибки : Success, InvalidIndex, NeedHeaderValidation
+GIA_TgaErr GIA_TgaDecoder::load_rle_index(const vector<uint8_t> &index)
+{
+    if ( state != FSM_States::HeaderValidated ) return GIA_TgaErr::NeedHeaderValidation;
+    rle_index.clear();
+    if ( ( image_type < 9 ) or ( index.size() < sizeof(GIA_TgaRleIndexHeader) ) ) return GIA_TgaErr::InvalidIndex;
+
+    /// индекс должен относиться именно к этому объекту : заголовок и размер пиксельных данных совпадают
+    GIA_TgaRleIndexHeader index_header;
+    memcpy(&index_header, index.data(), sizeof(index_header));
+    uint64_t pix_data_size = uint64_t(src_size - pix_data_offset);
+    if ( ( memcmp(index_header.magic, "GIATRI1\x00", 8) != 0 ) or ( memcmp(&index_header.header, header, sizeof(GIA_TgaHeader)) != 0 )
+         or ( index_header.pix_data_size != pix_data_size ) or ( index_header.rows_step < 1 )
+         or ( index_header.entry_count > ( uint64_t(height) + index_header.rows_step - 1 ) / index_header.rows_step )
+         or ( index.size() != sizeof(index_header) + uint64_t(index_header.entry_count) * sizeof(GIA_TgaRleIndexEntry) ) ) return GIA_TgaErr::InvalidIndex;
+
+    /// записи проверяются так, чтобы reader_seek никогда не читал за пределами пиксельных данных
+    vector<GIA_TgaRleIndexEntry> entries(index_header.entry_count);
+    memcpy(entries.data(), &index[sizeof(index_header)], entries.size() * sizeof(GIA_TgaRleIndexEntry));
+    uint8_t *pix_array = &src_array[pix_data_offset];
+    uint64_t prev_idx = 0;
+    for(auto &entry : entries)
+    {
+        if ( ( entry.src_idx < prev_idx ) or ( entry.src_idx > pix_data_size ) ) return GIA_TgaErr::InvalidIndex;
+        if ( entry.packet_done > 0 )
+        {
+            if ( entry.src_idx == pix_data_size ) return GIA_TgaErr::InvalidIndex;
+            uint8_t packet_hdr = pix_array[entry.src_idx];
+            uint64_t packet_len = (packet_hdr & 0b01111111) + 1;
+            uint64_t packet_bytes = 1 + ( ( (packet_hdr >> 7) == 1 ) ? 1 : packet_len ) * one_pix_size;
+            if ( ( entry.packet_done >= packet_len ) or ( pix_data_size - entry.src_idx < packet_bytes ) ) return GIA_TgaErr::InvalidIndex;
+        }
+        prev_idx = entry.src_idx;
+    }
+    rle_index.swap(entries);
+    rle_index_step = int(index_header.rows_step);
+    return GIA_TgaErr::Success;
+}
+
+void GIA_TgaDecoder::set_dst_buffer(uint8_t *buffer, int64_t buffer_size)
+{
+    ext_dst_array = buffer;
+    ext_dst_size = ( buffer != nullptr ) ? buffer_size : 0;
+}
+
+// может возвращать ошибки : MemAllocErr, SmallBuffer, Success
+GIA_TgaErr GIA_TgaDecoder::alloc_dst(int64_t alloc_size)
+{
+    if ( ext_dst_array != nullptr ) // буфер вызывающего используется один раз, памятью владеет вызывающий
+    {
+        bool is_enough = ext_dst_size >= alloc_size;
+        dst_array = is_enough ? ext_dst_array : nullptr;
+        is_data_detached = is_enough;
+        is_dst_external = is_enough;
+        ext_dst_array = nullptr;
+        ext_dst_size = 0;
+        return is_enough ? GIA_TgaErr::Success : GIA_TgaErr::SmallBuffer;
+    }
+    if ( ( own_array == nullptr ) or ( own_capacity < alloc_size ) ) // прежний массив переиспользуется, если новое изображение в нём помещается
+    {
+        delete [] own_array;
+        own_array = new (std::nothrow) uint8_t[alloc_size];
+        own_capacity = ( own_array != nullptr ) ? alloc_size : 0;
+    }
+    dst_array = own_array;
+    own_used = ( own_array != nullptr ) ? alloc_size : 0;
+    is_dst_external = false;
+    return ( dst_array == nullptr ) ? GIA_TgaErr::MemAllocErr : GIA_TgaErr::Success;
+}
+
+void GIA_TgaDecoder::release_dst()
+{
+    if ( !is_data_detached and ( dst_array != nullptr ) and !reuse_dst ) // без режима переиспользования массив освобождается, как раньше
+    {
+        delete [] own_array;
+        own_array = nullptr;
+        own_capacity = 0;
+    }
+    dst_array = nullptr;
+    own_used = 0;
+    is_data_detached = false;
+}
+
+void GIA_TgaDecoder::set_dst_reuse(bool enable)
+{
+    reuse_dst = enable;
+}
+
+// может возвращать ошибки : Success, MemAllocErr
+GIA_TgaErr GIA_TgaDecoder::reserve(int64_t new_capacity)
+{
+    if ( new_capacity <= own_capacity ) return GIA_TgaErr::Success;
+    auto new_array = new (std::nothrow) uint8_t[new_capacity];
+    if ( new_array == nullptr ) return GIA_TgaErr::MemAllocErr;
+    if ( own_used > 0 ) memcpy(new_array, own_array, own_used); // раскодированное изображение остаётся доступным через data()
+    if ( ( dst_array != nullptr ) and ( dst_array == own_array ) ) dst_array = new_array;
+    delete [] own_array;
+    own_array = new_array;
+    own_capacity = new_capacity;
+    return GIA_TgaErr::Success;
+}
+
+void GIA_TgaDecoder::shrink_to_fit()
+{
+    if ( own_capacity == own_used ) return;
+    uint8_t *new_array = nullptr;
+    if ( own_used > 0 )
+    {
+        new_array = new (std::nothrow) uint8_t[own_used];
+        if ( new_array == nullptr ) return; // без памяти на копию остаётся прежний массив
+        memcpy(new_array, own_array, own_used);
+    }
+    if ( ( dst_array != nullptr ) and ( dst_array == own_array ) ) dst_array = new_array;
+    delete [] own_array;
+    own_array = new_array;
+    own_capacity = own_used;
+}
+
+int64_t GIA_TgaDecoder::capacity()
+{
+    return own_capacity;
+}
+
+void GIA_TgaDecoder::reset_dims()
+{
+    width = header->width;
+    height = header->height;
+    bytes_per_line = width * 4;
+    total_size_p = int64_t(width) * height;
+    total_size_b = total_size_p * 4;
+}
+
+// может возвращать ошибки : MemAllocErr, Success
 GIA_TgaErr GIA_TgaDecoder::create_cmap_256()
 {
     color_map = new (std::nothrow) bbggrraa[256];
@@ -423,19 +2714,39 @@ GIA_TgaErr GIA_TgaDecoder::create_cmap_256()
     }
 
     /// обнуление палитры (потому что в файле она может быть короче 256 элементов)
-    for(uint16_t cm_dw_idx = 0; cm_dw_idx < 32; ++cm_dw_idx)
+    for(uint16_t cm_dw_idx = 0; cm_dw_idx < 128; ++cm_dw_idx) // 256 элементов по 4 байта = 128 qwords
     {
         ((uint64_t*)color_map)[cm_dw_idx] = 0xFF000000FF000000;
     }
+    auto cm_dst = &color_map[cmap_first]; // элементы из файла кладутся начиная с индекса cmap_start
     switch(cmap_elem_depth)
     {
+    case 15:
+    case 16:
+    {
+        /// 16-битный атрибут учитываем только если заголовок объявляет 1 бит альфа-канала, иначе элементы непрозрачные
+        bool use_attr = ( cmap_elem_depth == 16 ) and ( alpha_bits == 1 );
+        uint8_t blue, green, red;
+        auto w_cm_array = (uint16_t*)&src_array[cmap_offset];
+        for(uint16_t cm_idx = 0; cm_idx < cmap_len; ++cm_idx)
+        {
+            blue = (uint8_t) ( w_cm_array[cm_idx] & 0b00000000'00011111 );
+            green = (uint8_t) ( ( w_cm_array[cm_idx] >> 5 ) & 0b00000000'00011111 );
+            red = (uint8_t) ( ( w_cm_array[cm_idx] >> 10 ) & 0b00000000'00011111 );
+            cm_dst[cm_idx].BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
+            cm_dst[cm_idx].BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
+            cm_dst[cm_idx].BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
+            cm_dst[cm_idx].AA = ( use_attr and ( (w_cm_array[cm_idx] & 0b10000000'00000000) == 0b10000000'00000000 ) ) ? 0 : 255;
+        }
+        break;
+    }
     case 24:
     {
         auto trp_cm_array = (triplet*)&src_array[cmap_offset];
         for(uint16_t cm_idx = 0; cm_idx < cmap_len; ++cm_idx)
         {
-            color_map[cm_idx].BBGGRR = trp_cm_array[cm_idx];
-            color_map[cm_idx].AA = 0xFF;
+            cm_dst[cm_idx].BBGGRR = trp_cm_array[cm_idx];
+            cm_dst[cm_idx].AA = 0xFF;
         }
         break;
     }
@@ -444,11 +2755,14 @@ GIA_TgaErr GIA_TgaDecoder::create_cmap_256()
         auto dw_cm_array = (bbggrraa*)&src_array[cmap_offset];
         for(uint16_t cm_idx = 0; cm_idx < cmap_len; ++cm_idx)
         {
-            color_map[cm_idx] = dw_cm_array[cm_idx];
+            cm_dst[cm_idx] = dw_cm_array[cm_idx];
         }
         break;
     }
     }
+    if ( pp_active ) process_pixels((uint32_t*)color_map, 256, 0); // у палитровых изображений обработка выполняется один раз над палитрой
+    if ( stats_scan ) memcpy(stats_palette, color_map, sizeof(stats_palette)); // цвета для счётчиков индексов
+    if ( alpha_collect ) scan_alpha((uint32_t*)color_map, 256); // альфа палитры вместо сканирования пикселей : все 256 элементов, индексы вне объявленной палитры дают непрозрачный чёрный
     return GIA_TgaErr::Success;
 }
 
@@ -459,7 +2773,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_8()
         state = FSM_States::NotEnoughMem;
         return GIA_TgaErr::MemAllocErr;
     }
-    int64_t need_src_size = width * height; // требуемое количество исходных байт
+    int64_t need_src_size = int64_t(width) * height; // требуемое количество исходных байт
     int64_t remain_size = src_size - pix_data_offset; // фактическое количество исходных байт
     bool truncated = remain_size < need_src_size;
     if ( !truncated ) remain_size = need_src_size;
@@ -467,9 +2781,18 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_8()
     bbggrraa four_bytes;
     four_bytes.AA = 0xFF;
     auto dst_dw_array = (uint32_t*)dst_array; // destination dwords array
-    for(int64_t b_idx; b_idx < remain_size; ++b_idx)
+    for(int64_t row_start = 0; row_start < remain_size; row_start += width) // построчно, чтобы проверять отмену на границах сканлиний
     {
-        dst_dw_array[b_idx] = color_map[src_b_array[b_idx]].dword;
+        int64_t row_end = ( row_start + width < remain_size ) ? row_start + width : remain_size;
+        for(int64_t b_idx = row_start; b_idx < row_end; ++b_idx)
+        {
+            dst_dw_array[b_idx] = color_map[src_b_array[b_idx]].dword;
+        }
+        if ( stats_scan ) // считаются индексы : цвета добавит stats по палитре
+        {
+            for(int64_t b_idx = row_start; b_idx < row_end; ++b_idx) ++stats_index[src_b_array[b_idx]];
+        }
+        if ( ( row_end >= ctl_next_pix ) and !band_done(row_end) ) { delete [] color_map; state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
     }
     delete [] color_map;
     if ( truncated )
@@ -512,6 +2835,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_rle8()
             {
                 /// мультипликация байтов пикселя
                 fill_with_dword(color_map[rle_array[src_idx]].dword, &dst_array[dst_idx], group_cnt);
+                if ( stats_scan ) stats_index[rle_array[src_idx]] += group_cnt;
                 ///
                 src_idx += 1; // перестановка на следующий счётчик группы
             }
@@ -533,6 +2857,10 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_rle8()
                 {
                     *((uint32_t*)&dst_array[dst_idx + (b_idx << 2)]) = color_map[src_b_array[b_idx]].dword; // b_idx*4
                 }
+                if ( stats_scan )
+                {
+                    for(int64_t b_idx = 0; b_idx < group_cnt; ++b_idx) ++stats_index[src_b_array[b_idx]];
+                }
                 ///
                 src_idx += group_cnt; // перестановка на следующий счётчик группы
             }
@@ -545,6 +2873,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_rle8()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции для заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { delete [] color_map; state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -555,7 +2884,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_cm_rle8()
 
 GIA_TgaErr GIA_TgaDecoder::decode_gr_8()
 {
-    int64_t need_src_size = width * height; // требуемое количество исходных байт
+    int64_t need_src_size = int64_t(width) * height; // требуемое количество исходных байт
     int64_t remain_size = src_size - pix_data_offset; // фактическое количество исходных байт
     bool truncated = remain_size < need_src_size;
     if ( !truncated ) remain_size = need_src_size;
@@ -563,12 +2892,18 @@ GIA_TgaErr GIA_TgaDecoder::decode_gr_8()
     bbggrraa four_bytes;
     four_bytes.AA = 0xFF;
     auto dst_dw_array = (uint32_t*)dst_array; // destination dwords array
-    for(int64_t b_idx; b_idx < remain_size; ++b_idx)
+    for(int64_t row_start = 0; row_start < remain_size; row_start += width) // построчно, чтобы обработка пикселей шла по горячей сканлинии
     {
-        four_bytes.BBGGRR.BB = src_b_array[b_idx];
-        four_bytes.BBGGRR.GG = four_bytes.BBGGRR.BB;
-        four_bytes.BBGGRR.RR = four_bytes.BBGGRR.BB;
-        dst_dw_array[b_idx] = four_bytes.dword;
+        int64_t row_end = ( row_start + width < remain_size ) ? row_start + width : remain_size;
+        for(int64_t b_idx = row_start; b_idx < row_end; ++b_idx)
+        {
+            four_bytes.BBGGRR.BB = src_b_array[b_idx];
+            four_bytes.BBGGRR.GG = four_bytes.BBGGRR.BB;
+            four_bytes.BBGGRR.RR = four_bytes.BBGGRR.BB;
+            dst_dw_array[b_idx] = four_bytes.dword;
+        }
+        if ( pp_active ) process_pixels(&dst_dw_array[row_start], row_end - row_start); // сканлиния ещё в кэше
+        if ( ( row_end >= ctl_next_pix ) and !band_done(row_end) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
     }
     if ( truncated )
     {
@@ -609,7 +2944,9 @@ GIA_TgaErr GIA_TgaDecoder::decode_gr_rle8()
                 four_bytes.BBGGRR.BB = rle_array[src_idx];
                 four_bytes.BBGGRR.GG = four_bytes.BBGGRR.BB;
                 four_bytes.BBGGRR.RR = four_bytes.BBGGRR.BB;
-                fill_with_dword(four_bytes.dword, &dst_array[dst_idx], group_cnt);
+                uint32_t rle_pixel = four_bytes.dword; // обработка идёт над копией : альфа в four_bytes задана один раз на всё декодирование
+                if ( pp_active ) process_pixels(&rle_pixel, 1, group_cnt); // пиксель rle-группы обрабатывается один раз, в статистику идёт с весом группы
+                fill_with_dword(rle_pixel, &dst_array[dst_idx], group_cnt);
                 ///
                 src_idx += 1; // перестановка на следующий счётчик группы
             }
@@ -633,6 +2970,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_gr_rle8()
                     four_bytes.BBGGRR.RR = four_bytes.BBGGRR.BB;
                     *((uint32_t*)&dst_array[dst_idx + (b_idx << 2)]) = four_bytes.dword; // b_idx*4
                 }
+                if ( pp_active ) process_pixels((uint32_t*)&dst_array[dst_idx], group_cnt); // группа ещё в кэше
                 ///
                 src_idx += group_cnt; // перестановка на следующий счётчик группы
             }
@@ -644,6 +2982,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_gr_rle8()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции для заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -653,26 +2992,32 @@ GIA_TgaErr GIA_TgaDecoder::decode_gr_rle8()
 
 GIA_TgaErr GIA_TgaDecoder::decode_tc_15()
 {
-    int64_t need_src_size = (width * height) << 1; // требуемое количество исходных байт : (w*h*2)
+    int64_t need_src_size = ( int64_t(width) * height ) << 1; // требуемое количество исходных байт : (w*h*2)
     int64_t remain_size = src_size - pix_data_offset; // фактическое количество исходных байт
     bool truncated = remain_size < need_src_size;
     if ( !truncated ) remain_size = need_src_size;
-    int64_t calc_size = remain_size & 0xFFFFFFFE; // нормализация размера исходных данных к границе 2 байт (обнуление 0 бита)
+    int64_t calc_size = remain_size & ~int64_t(1); // нормализация размера исходных данных к границе 2 байт (обнуление 0 бита)
     int64_t max_words = calc_size >> 1;
     bbggrraa four_bytes;
     four_bytes.AA = 0xFF;
     uint8_t blue, green, red;
     auto src_w_array = (uint16_t*)&src_array[pix_data_offset]; // source words array
     auto dst_dw_array = (uint32_t*)dst_array; // destination dwords array
-    for(int64_t w_idx = 0; w_idx < max_words; ++w_idx)
+    for(int64_t row_start = 0; row_start < max_words; row_start += width) // построчно, чтобы обработка пикселей шла по горячей сканлинии
     {
-        blue = (uint8_t) ( src_w_array[w_idx] & 0b00000000'00011111 );
-        green = (uint8_t) ( ( src_w_array[w_idx] >> 5 ) & 0b00000000'00011111 );
-        red = (uint8_t) ( ( src_w_array[w_idx] >> 10 ) & 0b00000000'00011111 );
-        four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
-        four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
-        four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
-        dst_dw_array[w_idx] = four_bytes.dword;
+        int64_t row_end = ( row_start + width < max_words ) ? row_start + width : max_words;
+        for(int64_t w_idx = row_start; w_idx < row_end; ++w_idx)
+        {
+            blue = (uint8_t) ( src_w_array[w_idx] & 0b00000000'00011111 );
+            green = (uint8_t) ( ( src_w_array[w_idx] >> 5 ) & 0b00000000'00011111 );
+            red = (uint8_t) ( ( src_w_array[w_idx] >> 10 ) & 0b00000000'00011111 );
+            four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
+            four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
+            four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
+            dst_dw_array[w_idx] = four_bytes.dword;
+        }
+        if ( pp_active ) process_pixels(&dst_dw_array[row_start], row_end - row_start); // сканлиния ещё в кэше
+        if ( ( row_end >= ctl_next_pix ) and !band_done(row_end) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
     }
     if ( truncated )
     {
@@ -688,26 +3033,32 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_15()
 
 GIA_TgaErr GIA_TgaDecoder::decode_tc_16()
 {
-    int64_t need_src_size = (width * height) << 1; // требуемое количество исходных байт : (w*h*2)
+    int64_t need_src_size = ( int64_t(width) * height ) << 1; // требуемое количество исходных байт : (w*h*2)
     int64_t remain_size = src_size - pix_data_offset; // фактическое количество исходных байт
     bool truncated = remain_size < need_src_size;
     if ( !truncated ) remain_size = need_src_size;
-    int64_t calc_size = remain_size & 0xFFFFFFFE; // нормализация размера исходных данных к границе 2 байт (обнуление 0 бита)
+    int64_t calc_size = remain_size & ~int64_t(1); // нормализация размера исходных данных к границе 2 байт (обнуление 0 бита)
     int64_t max_words = calc_size >> 1;
     bbggrraa four_bytes;
     uint8_t blue, green, red;
     auto src_w_array = (uint16_t*)&src_array[pix_data_offset]; // source words array
     auto dst_dw_array = (uint32_t*)dst_array; // destination dwords array
-    for(int64_t w_idx = 0; w_idx < max_words; ++w_idx)
+    for(int64_t row_start = 0; row_start < max_words; row_start += width) // построчно, чтобы обработка пикселей шла по горячей сканлинии
     {
-        blue = (uint8_t) ( src_w_array[w_idx] & 0b00000000'00011111 );
-        green = (uint8_t) ( ( src_w_array[w_idx] >> 5 ) & 0b00000000'00011111 );
-        red = (uint8_t) ( ( src_w_array[w_idx] >> 10 ) & 0b00000000'00011111 );
-        four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
-        four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
-        four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
-        four_bytes.AA = ( (src_w_array[w_idx] & 0b10000000'00000000) == 0b10000000'00000000 ) ? 0 : 255;
-        dst_dw_array[w_idx] = four_bytes.dword;
+        int64_t row_end = ( row_start + width < max_words ) ? row_start + width : max_words;
+        for(int64_t w_idx = row_start; w_idx < row_end; ++w_idx)
+        {
+            blue = (uint8_t) ( src_w_array[w_idx] & 0b00000000'00011111 );
+            green = (uint8_t) ( ( src_w_array[w_idx] >> 5 ) & 0b00000000'00011111 );
+            red = (uint8_t) ( ( src_w_array[w_idx] >> 10 ) & 0b00000000'00011111 );
+            four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
+            four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
+            four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
+            four_bytes.AA = ( (src_w_array[w_idx] & 0b10000000'00000000) == 0b10000000'00000000 ) ? 0 : 255;
+            dst_dw_array[w_idx] = four_bytes.dword;
+        }
+        if ( pp_active ) process_pixels(&dst_dw_array[row_start], row_end - row_start); // сканлиния ещё в кэше
+        if ( ( row_end >= ctl_next_pix ) and !band_done(row_end) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
     }
     if ( truncated )
     {
@@ -723,7 +3074,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_16()
 
 GIA_TgaErr GIA_TgaDecoder::decode_tc_24()
 {
-    int64_t need_src_size = width * height * 3; // требуемое количество исходных байт
+    int64_t need_src_size = int64_t(width) * height * 3; // требуемое количество исходных байт
     int64_t remain_size = src_size - pix_data_offset;
     bool truncated = remain_size < need_src_size;
     if ( !truncated ) remain_size = need_src_size;
@@ -733,10 +3084,16 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_24()
     four_bytes.AA = 0xFF;
     auto src_trp_array = (triplet*)&src_array[pix_data_offset]; // source triplets array
     auto dst_dw_array = (uint32_t*)dst_array; // destination dwords array
-    for(int64_t trp_idx = 0; trp_idx < max_triplets; ++trp_idx)
+    for(int64_t row_start = 0; row_start < max_triplets; row_start += width) // построчно, чтобы обработка пикселей шла по горячей сканлинии
     {
-        four_bytes.BBGGRR = src_trp_array[trp_idx];
-        dst_dw_array[trp_idx] = four_bytes.dword;
+        int64_t row_end = ( row_start + width < max_triplets ) ? row_start + width : max_triplets;
+        for(int64_t trp_idx = row_start; trp_idx < row_end; ++trp_idx)
+        {
+            four_bytes.BBGGRR = src_trp_array[trp_idx];
+            dst_dw_array[trp_idx] = four_bytes.dword;
+        }
+        if ( pp_active ) process_pixels(&dst_dw_array[row_start], row_end - row_start); // сканлиния ещё в кэше
+        if ( ( row_end >= ctl_next_pix ) and !band_done(row_end) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
     }
     if ( truncated )
     {
@@ -755,8 +3112,14 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_32()
     int64_t remain_size = src_size - pix_data_offset;
     bool truncated = remain_size < total_size_b;
     if ( !truncated ) remain_size = total_size_b;
-    int64_t calc_size = remain_size & 0xFFFFFFFC; // нормализация размера исходных данных к границе 4 байт (обнуление 2 младших битов)
-    memcpy(dst_array, &src_array[pix_data_offset], calc_size);
+    int64_t calc_size = remain_size & ~int64_t(3); // нормализация размера исходных данных к границе 4 байт (обнуление 2 младших битов)
+    for(int64_t row_start = 0; row_start < calc_size; row_start += bytes_per_line) // построчно, чтобы обработка пикселей шла по горячей сканлинии
+    {
+        int64_t row_size = ( row_start + bytes_per_line < calc_size ) ? bytes_per_line : calc_size - row_start;
+        memcpy(&dst_array[row_start], &src_array[pix_data_offset + row_start], row_size);
+        if ( pp_active ) process_pixels((uint32_t*)&dst_array[row_start], row_size >> 2); // сканлиния ещё в кэше
+        if ( ( ( row_start + row_size ) >> 2 >= ctl_next_pix ) and !band_done(( row_start + row_size ) >> 2) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
+    }
     if ( truncated )
     {
         state = FSM_States::DecodingAbort;
@@ -801,7 +3164,9 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle15()
                 four_bytes.BBGGRR.BB = ( blue << 3 ) | ( blue >> 2 );
                 four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
                 four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
-                fill_with_dword(four_bytes.dword, &dst_array[dst_idx], group_cnt);
+                uint32_t rle_pixel = four_bytes.dword; // обработка идёт над копией : альфа в four_bytes задана один раз на всё декодирование
+                if ( pp_active ) process_pixels(&rle_pixel, 1, group_cnt); // пиксель rle-группы обрабатывается один раз, в статистику идёт с весом группы
+                fill_with_dword(rle_pixel, &dst_array[dst_idx], group_cnt);
                 ///
                 src_idx += (16/8); // перестановка на следующий счётчик группы
             }
@@ -829,6 +3194,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle15()
                     four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2 );
                     *((uint32_t*)&dst_array[dst_idx + (w_idx << 2)]) = four_bytes.dword; // w_idx*4
                 }
+                if ( pp_active ) process_pixels((uint32_t*)&dst_array[dst_idx], group_cnt); // группа ещё в кэше
                 ///
                 src_idx += not_packed_bytes; // перестановка на следующий счётчик группы
             }
@@ -840,6 +3206,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle15()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -879,6 +3246,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle16()
                 four_bytes.BBGGRR.GG = ( green << 3 ) | ( green >> 2 );
                 four_bytes.BBGGRR.RR = ( red << 3 ) | ( red >> 2);
                 four_bytes.AA = ( (rle_array[src_idx + 1] & 0b10000000) == 0b10000000 ) ? 0 : 255;
+                if ( pp_active ) process_pixels(&four_bytes.dword, 1, group_cnt); // пиксель rle-группы обрабатывается один раз, в статистику идёт с весом группы
                 fill_with_dword(four_bytes.dword, &dst_array[dst_idx], group_cnt);
                 ///
                 src_idx += 2; // перестановка на следующий счётчик группы
@@ -908,6 +3276,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle16()
                     four_bytes.AA = ( (w_array[w_idx] & 0b10000000'00000000) == 0b10000000'00000000 ) ? 0 : 255;
                     *((uint32_t*)&dst_array[dst_idx + (w_idx << 2)]) = four_bytes.dword; // w_idx*4
                 }
+                if ( pp_active ) process_pixels((uint32_t*)&dst_array[dst_idx], group_cnt); // группа ещё в кэше
                 ///
                 src_idx += not_packed_bytes; // перестановка на следующий счётчик группы
             }
@@ -919,6 +3288,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle16()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -952,7 +3322,9 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle24()
             {
                 /// мультипликация байтов пикселя
                 four_bytes.BBGGRR = *((triplet*)&rle_array[src_idx]);
-                fill_with_dword(four_bytes.dword, &dst_array[dst_idx], group_cnt);
+                uint32_t rle_pixel = four_bytes.dword; // обработка идёт над копией : альфа в four_bytes задана один раз на всё декодирование
+                if ( pp_active ) process_pixels(&rle_pixel, 1, group_cnt); // пиксель rle-группы обрабатывается один раз, в статистику идёт с весом группы
+                fill_with_dword(rle_pixel, &dst_array[dst_idx], group_cnt);
                 ///
                 src_idx += (24/8); // перестановка на следующий счётчик группы
             }
@@ -974,6 +3346,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle24()
                     four_bytes.BBGGRR = ((triplet*)&rle_array[src_idx])[trp_idx];
                     *((uint32_t*)&dst_array[dst_idx + (trp_idx << 2)]) = four_bytes.dword; // trp_idx*4
                 }
+                if ( pp_active ) process_pixels((uint32_t*)&dst_array[dst_idx], group_cnt); // группа ещё в кэше
                 ///
                 src_idx += not_packed_bytes; // перестановка на следующий счётчик группы
             }
@@ -985,6 +3358,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle24()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -1015,7 +3389,9 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle32()
             if ( rle_size - src_idx >= 4 ) // хватает ли места в исходном буфере на 4 байта пикселя?
             {
                 /// мультипликация байтов пикселя
-                fill_with_dword(*((uint32_t*)&rle_array[src_idx]), &dst_array[dst_idx], group_cnt);
+                uint32_t rle_pixel = *((uint32_t*)&rle_array[src_idx]);
+                if ( pp_active ) process_pixels(&rle_pixel, 1, group_cnt); // пиксель rle-группы обрабатывается один раз, в статистику идёт с весом группы
+                fill_with_dword(rle_pixel, &dst_array[dst_idx], group_cnt);
                 ///
                 src_idx += 4; // перестановка на следующий счётчик группы
             }
@@ -1033,6 +3409,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle32()
             {
                 /// копирование байтов пикселей
                 memcpy(&dst_array[dst_idx], &rle_array[src_idx], not_packed_bytes);
+                if ( pp_active ) process_pixels((uint32_t*)&dst_array[dst_idx], group_cnt); // группа ещё в кэше
                 ///
                 src_idx += not_packed_bytes; // перестановка на следующий счётчик группы
             }
@@ -1044,6 +3421,7 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle32()
         }
 
         dst_idx += (group_cnt << 2); // обновляем общий счётчик байтов (он же индекс следующей позиции для заполнения в dst_array) : сдвиг влево на 2 = *4
+        if ( ( pix_cnt >= ctl_next_pix ) and !band_done(pix_cnt) ) { state = FSM_States::DecodingAbort; return ctl_stop; } // досрочный выход : отмена или исчерпан бюджет
 
     } while(pix_cnt < total_size_p); // декодировали пикселей столько, сколько должны => конец цикла
 
@@ -1051,4 +3429,927 @@ GIA_TgaErr GIA_TgaDecoder::decode_tc_rle32()
     return GIA_TgaErr::Success;
 }
 
+
+GIA_TgaCache::GIA_TgaCache(int64_t budget_bytes, int shard_count)
+{
+    if ( shard_count < 1 ) shard_count = 1;
+    for(int shard_idx = 0; shard_idx < shard_count; ++shard_idx) shards.push_back(make_unique<cache_shard>());
+    shard_budget = budget_bytes / shard_count;
+}
+
+int64_t GIA_TgaCache::entry_bytes(const GIA_TgaImage &image)
+{
+    return int64_t(image.data.size()) + int64_t(sizeof(GIA_TgaImage)) + int64_t(sizeof(cache_entry));
+}
+
+// может возвращать ошибки : InvalidHeader, MemAllocErr, Success, TruncDataAbort, TooMuchPixAbort
+shared_ptr<const GIA_TgaImage> GIA_TgaCache::get(uint8_t *object_ptr, int64_t object_size, GIA_TgaErr *err)
+{
+    uint64_t hash = content_hash(object_ptr, object_size);
+    uint64_t check = content_hash(object_ptr, object_size, check_seed); // коллизия hash не должна выдать чужое изображение
+    cache_shard &shard = *shards[hash % shards.size()];
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto range = shard.index.equal_range(hash);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if ( ( it->second->src_size != object_size ) or ( it->second->check != check ) ) continue;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // в начало списка LRU
+            if ( err != nullptr ) *err = it->second->image->result;
+            return it->second->image;
+        }
+    }
+    /// промах : декодирование идёт без блокировки шарда
+    GIA_TgaErr result;
+    auto image = decode_image(object_ptr, object_size, &result);
+    if ( err != nullptr ) *err = result;
+    if ( image == nullptr ) return nullptr;
+
+    int64_t image_bytes = entry_bytes(*image);
+    if ( image_bytes > shard_budget ) return image; // не помещается в шард : отдаётся без кэширования
+    lock_guard<mutex> guard(shard.lock);
+    auto range = shard.index.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it) // другой поток мог успеть декодировать тот же объект
+    {
+        if ( ( it->second->src_size != object_size ) or ( it->second->check != check ) ) continue;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // в начало списка LRU, как при попадании
+        return it->second->image;
+    }
+    shard.lru.push_front(cache_entry { hash, check, object_size, image });
+    shard.index.emplace(hash, shard.lru.begin());
+    shard.used_bytes += image_bytes;
+    while ( shard.used_bytes > shard_budget ) // вытеснение давно неиспользованных
+    {
+        cache_entry &victim = shard.lru.back();
+        auto victim_range = shard.index.equal_range(victim.hash);
+        for(auto it = victim_range.first; it != victim_range.second; ++it)
+        {
+            if ( it->second == prev(shard.lru.end()) )
+            {
+                shard.index.erase(it);
+                break;
+            }
+        }
+        shard.used_bytes -= entry_bytes(*victim.image);
+        shard.lru.pop_back();
+    }
+    return image;
+}
+
+// может возвращать ошибки : InvalidHeader, MemAllocErr, Success, TruncDataAbort, TooMuchPixAbort
+shared_ptr<const GIA_TgaImage> GIA_TgaCache::decode_image(uint8_t *object_ptr, int64_t object_size, GIA_TgaErr *err)
+{
+    /// декодирование прямо в буфер будущего изображения
+    GIA_TgaDecoder decoder;
+    decoder.init(object_ptr, object_size);
+    GIA_TgaErr result = decoder.validate_header();
+    if ( result != GIA_TgaErr::ValidHeader )
+    {
+        if ( err != nullptr ) *err = result;
+        return nullptr;
+    }
+    GIA_TgaInfo info = decoder.info();
+    auto image = make_shared<GIA_TgaImage>();
+    image->width = info.width;
+    image->height = info.height;
+    image->bytes_per_line = info.bytes_per_line;
+    image->data.resize(info.total_size);
+    decoder.set_dst_buffer(image->data.data(), image->data.size());
+    result = decoder.decode();
+    if ( err != nullptr ) *err = result;
+    if ( ( result != GIA_TgaErr::Success ) and ( result != GIA_TgaErr::TruncDataAbort ) and ( result != GIA_TgaErr::TooMuchPixAbort ) ) return nullptr;
+    decoder.flip();
+    image->result = result;
+    return image;
+}
+
+void GIA_TgaCache::clear()
+{
+    for(auto &shard : shards)
+    {
+        lock_guard<mutex> guard(shard->lock);
+        shard->index.clear();
+        shard->lru.clear();
+        shard->used_bytes = 0;
+    }
+}
+
+int64_t GIA_TgaCache::used_bytes()
+{
+    int64_t total = 0;
+    for(auto &shard : shards)
+    {
+        lock_guard<mutex> guard(shard->lock);
+        total += shard->used_bytes;
+    }
+    return total;
+}
+
+uint64_t GIA_TgaCache::content_hash(const uint8_t *data, int64_t size, uint64_t seed)
+{
+    const uint64_t prime_1 = 0x9E3779B185EBCA87;
+    const uint64_t prime_2 = 0xC2B2AE3D27D4EB4F;
+    const uint64_t prime_3 = 0x165667B19E3779F9;
+    const uint64_t prime_4 = 0x85EBCA77C2B2AE63;
+    const uint64_t prime_5 = 0x27D4EB2F165667C5;
+    auto rotl = [](uint64_t value, int bits) { return ( value << bits ) | ( value >> ( 64 - bits ) ); };
+    auto mix_round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * prime_2, 31) * prime_1; };
+    auto read_64 = [](const uint8_t *ptr) { uint64_t value; memcpy(&value, ptr, 8); return value; }; // little-endian, как и вся библиотека
+    auto read_32 = [](const uint8_t *ptr) { uint32_t value; memcpy(&value, ptr, 4); return uint64_t(value); };
+
+    const uint8_t *ptr = data;
+    const uint8_t *end = data + size;
+    uint64_t hash;
+    if ( size >= 32 ) // 4 независимых аккумулятора по полосам из 32 байт
+    {
+        uint64_t acc_1 = seed + prime_1 + prime_2;
+        uint64_t acc_2 = seed + prime_2;
+        uint64_t acc_3 = seed;
+        uint64_t acc_4 = seed - prime_1;
+        for(; end - ptr >= 32; ptr += 32)
+        {
+            acc_1 = mix_round(acc_1, read_64(ptr));
+            acc_2 = mix_round(acc_2, read_64(ptr + 8));
+            acc_3 = mix_round(acc_3, read_64(ptr + 16));
+            acc_4 = mix_round(acc_4, read_64(ptr + 24));
+        }
+        hash = rotl(acc_1, 1) + rotl(acc_2, 7) + rotl(acc_3, 12) + rotl(acc_4, 18);
+        for(uint64_t acc : { acc_1, acc_2, acc_3, acc_4 }) hash = ( hash ^ mix_round(0, acc) ) * prime_1 + prime_4;
+    }
+    else
+    {
+        hash = seed + prime_5;
+    }
+    hash += uint64_t(size);
+    for(; end - ptr >= 8; ptr += 8) hash = rotl(hash ^ mix_round(0, read_64(ptr)), 27) * prime_1 + prime_4;
+    if ( end - ptr >= 4 )
+    {
+        hash = rotl(hash ^ ( read_32(ptr) * prime_1 ), 23) * prime_2 + prime_3;
+        ptr += 4;
+    }
+    for(; ptr < end; ++ptr) hash = rotl(hash ^ ( *ptr * prime_5 ), 11) * prime_1;
+    /// финальное перемешивание
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    hash *= prime_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+
+GIA_TgaBulkLoader::GIA_TgaBulkLoader(int threads, int depth, GIA_TgaCache *image_cache)
+{
+    if ( threads < 1 ) threads = int(std::thread::hardware_concurrency());
+    thread_count = ( threads < 1 ) ? 1 : threads;
+    queue_depth = clamp(depth, 1, 4096);
+    cache = image_cache;
+}
+
+void GIA_TgaBulkLoader::set_io_uring(bool enable)
+{
+    uring_enabled = enable;
+}
+
+bool GIA_TgaBulkLoader::io_uring_used()
+{
+    return uring_used;
+}
+
+void GIA_TgaBulkLoader::load(const vector<string> &paths, GIA_TgaLoadDone done)
+{
+    uring_used = false;
+    if ( paths.empty() ) return;
+    if ( uring_enabled and load_uring(paths, done) )
+    {
+        uring_used = true;
+        return;
+    }
+    load_pread(paths, done);
+}
+
+void GIA_TgaBulkLoader::finish_job(load_job &job, const GIA_TgaLoadDone &done)
+{
+    if ( job.read_result != GIA_TgaErr::Success )
+    {
+        done(job.file_idx, job.read_result, nullptr);
+        return;
+    }
+    GIA_TgaErr result;
+    shared_ptr<const GIA_TgaImage> image;
+    if ( cache != nullptr ) image = cache->get(job.bytes.data(), job.bytes.size(), &result);
+    else image = GIA_TgaCache::decode_image(job.bytes.data(), job.bytes.size(), &result);
+    vector<uint8_t>().swap(job.bytes); // исходные байты больше не нужны, память освобождается до вызова done
+    done(job.file_idx, result, image);
+}
+
+// может возвращать ошибки : Success, FileIOErr
+GIA_TgaErr GIA_TgaBulkLoader::read_file(const string &path, vector<uint8_t> &bytes)
+{
+#ifdef GIA_TGA_POSIX
+    int file_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( file_fd < 0 ) return GIA_TgaErr::FileIOErr;
+    struct stat file_stat;
+    if ( fstat(file_fd, &file_stat) != 0 )
+    {
+        ::close(file_fd);
+        return GIA_TgaErr::FileIOErr;
+    }
+    bytes.resize(file_stat.st_size);
+    int64_t done_bytes = 0;
+    while ( done_bytes < int64_t(bytes.size()) ) // pread может вернуть меньше запрошенного
+    {
+        ssize_t got_bytes = ::pread(file_fd, &bytes[done_bytes], bytes.size() - done_bytes, done_bytes);
+        if ( ( got_bytes < 0 ) and ( errno == EINTR ) ) continue;
+        if ( got_bytes <= 0 ) break; // ошибка или файл укоротился
+        done_bytes += got_bytes;
+    }
+    ::close(file_fd);
+    return ( done_bytes == int64_t(bytes.size()) ) ? GIA_TgaErr::Success : GIA_TgaErr::FileIOErr;
+#else
+    ifstream file(path, ios::binary | ios::ate);
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    bytes.resize(int64_t(file.tellg()));
+    file.seekg(0);
+    file.read((char*)bytes.data(), bytes.size());
+    return file ? GIA_TgaErr::Success : GIA_TgaErr::FileIOErr;
+#endif
+}
+
+void GIA_TgaBulkLoader::load_pread(const vector<string> &paths, const GIA_TgaLoadDone &done)
+{
+    /// каждый поток сам читает свой файл и сразу его декодирует : чтение одних файлов перекрывается декодированием других
+    atomic<size_t> next_file(0);
+    auto worker = [&]()
+    {
+        for(size_t file_idx = next_file++; file_idx < paths.size(); file_idx = next_file++)
+        {
+            load_job job { file_idx, GIA_TgaErr::Success, {} };
+            job.read_result = read_file(paths[file_idx], job.bytes);
+            finish_job(job, done);
+        }
+    };
+    size_t worker_count = min(size_t(thread_count), paths.size());
+    vector<thread> workers;
+    for(size_t worker_idx = 1; worker_idx < worker_count; ++worker_idx) workers.emplace_back(worker);
+    worker(); // вызывающий поток работает наравне с остальными
+    for(auto &one_worker : workers) one_worker.join();
+}
+
+bool GIA_TgaBulkLoader::load_uring(const vector<string> &paths, const GIA_TgaLoadDone &done)
+{
+#ifndef GIA_TGA_URING
+    (void)paths;
+    (void)done;
+    return false;
+#else
+    /// кольца io_uring напрямую через системные вызовы (без liburing)
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = int(syscall(__NR_io_uring_setup, unsigned(queue_depth), &params));
+    if ( ring_fd < 0 ) return false; // ядро без io_uring или он запрещён политикой : запасной режим
+    size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP; // кольца подачи и завершений в одном отображении
+    if ( single_mmap ) sq_ring_size = cq_ring_size = max(sq_ring_size, cq_ring_size);
+    auto sq_ring = (uint8_t*)mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    auto cq_ring = single_mmap ? sq_ring : (uint8_t*)mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    auto sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    auto release_ring = [&]()
+    {
+        if ( sqes != MAP_FAILED ) munmap(sqes, sqes_size);
+        if ( ( cq_ring != sq_ring ) and ( cq_ring != MAP_FAILED ) ) munmap(cq_ring, cq_ring_size);
+        if ( sq_ring != MAP_FAILED ) munmap(sq_ring, sq_ring_size);
+        ::close(ring_fd);
+    };
+    if ( ( sq_ring == MAP_FAILED ) or ( cq_ring == MAP_FAILED ) or ( (void*)sqes == MAP_FAILED ) )
+    {
+        release_ring();
+        return false;
+    }
+    unsigned *sq_head = (unsigned*)&sq_ring[params.sq_off.head];
+    unsigned *sq_tail = (unsigned*)&sq_ring[params.sq_off.tail];
+    unsigned sq_mask = *(unsigned*)&sq_ring[params.sq_off.ring_mask];
+    unsigned *sq_array = (unsigned*)&sq_ring[params.sq_off.array];
+    unsigned *cq_head = (unsigned*)&cq_ring[params.cq_off.head];
+    unsigned *cq_tail = (unsigned*)&cq_ring[params.cq_off.tail];
+    unsigned cq_mask = *(unsigned*)&cq_ring[params.cq_off.ring_mask];
+    auto cqes = (io_uring_cqe*)&cq_ring[params.cq_off.cqes];
+
+    /// очередь прочитанных файлов для потоков декодирования; ограничена, чтобы чтение не убегало далеко вперёд
+    mutex ready_lock;
+    condition_variable ready_cond; // появился файл или чтение закончено
+    condition_variable space_cond; // в очереди освободилось место
+    deque<load_job> ready;
+    bool reading_done = false;
+    size_t ready_max = size_t(thread_count) * 2;
+    auto decode_worker = [&]()
+    {
+        unique_lock<mutex> guard(ready_lock);
+        while ( true )
+        {
+            ready_cond.wait(guard, [&]() { return !ready.empty() or reading_done; });
+            if ( ready.empty() ) return;
+            load_job job = std::move(ready.front());
+            ready.pop_front();
+            guard.unlock();
+            space_cond.notify_one();
+            finish_job(job, done);
+            guard.lock();
+        }
+    };
+    auto push_ready = [&](load_job &&job)
+    {
+        unique_lock<mutex> guard(ready_lock);
+        space_cond.wait(guard, [&]() { return ready.size() < ready_max; });
+        ready.push_back(std::move(job));
+        guard.unlock();
+        ready_cond.notify_one();
+    };
+    vector<thread> workers;
+    for(int worker_idx = 0; worker_idx < thread_count; ++worker_idx) workers.emplace_back(decode_worker);
+
+    /// слоты чтений : на каждый слот не больше одной записи в кольце подачи, поэтому кольцо не переполняется
+    struct read_slot
+    {
+        load_job job;
+        int file_fd;
+        int64_t done_bytes;
+        iovec chunk;
+        bool busy; // чтение слота отправлено в кольцо и ещё не завершилось
+    };
+    vector<read_slot> slots(params.sq_entries);
+    vector<unsigned> free_slots;
+    for(unsigned slot_idx = params.sq_entries; slot_idx > 0; --slot_idx) free_slots.push_back(slot_idx - 1);
+    auto queue_read = [&](unsigned slot_idx) // остаток файла (не больше 1 ГБ за раз) в кольцо подачи
+    {
+        read_slot &slot = slots[slot_idx];
+        slot.chunk.iov_base = &slot.job.bytes[slot.done_bytes];
+        slot.chunk.iov_len = size_t(min(int64_t(slot.job.bytes.size()) - slot.done_bytes, int64_t(1) << 30));
+        unsigned tail = *sq_tail; // хвост подачи пишет только этот поток
+        io_uring_sqe &sqe = sqes[tail & sq_mask];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = slot.file_fd;
+        sqe.addr = uint64_t(uintptr_t(&slot.chunk));
+        sqe.len = 1;
+        sqe.off = uint64_t(slot.done_bytes);
+        sqe.user_data = slot_idx;
+        sq_array[tail & sq_mask] = tail & sq_mask;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    };
+
+    size_t next_file = 0;
+    unsigned in_flight = 0; // занятые слоты
+    bool ring_failed = false;
+    while ( ( next_file < paths.size() ) or ( in_flight > 0 ) )
+    {
+        /// открытие следующих файлов в свободные слоты
+        while ( !free_slots.empty() and ( next_file < paths.size() ) )
+        {
+            load_job job { next_file, GIA_TgaErr::Success, {} };
+            int file_fd = ::open(paths[next_file++].c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat file_stat;
+            if ( ( file_fd < 0 ) or ( fstat(file_fd, &file_stat) != 0 ) )
+            {
+                if ( file_fd >= 0 ) ::close(file_fd);
+                job.read_result = GIA_TgaErr::FileIOErr;
+                push_ready(std::move(job));
+                continue;
+            }
+            job.bytes.resize(file_stat.st_size);
+            if ( job.bytes.empty() ) // читать нечего, декодер сам сообщит о пустом объекте
+            {
+                ::close(file_fd);
+                push_ready(std::move(job));
+                continue;
+            }
+            unsigned slot_idx = free_slots.back();
+            free_slots.pop_back();
+            slots[slot_idx].job = std::move(job);
+            slots[slot_idx].file_fd = file_fd;
+            slots[slot_idx].done_bytes = 0;
+            slots[slot_idx].busy = true;
+            queue_read(slot_idx);
+            ++in_flight;
+        }
+        /// один системный вызов : отправка всей пачки чтений и ожидание хотя бы одного завершения
+        unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if ( syscall(__NR_io_uring_enter, ring_fd, to_submit, ( in_flight > 0 ) ? 1 : 0, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 )
+        {
+            if ( ( errno == EINTR ) or ( errno == EAGAIN ) or ( errno == EBUSY ) ) continue;
+            ring_failed = true;
+            break;
+        }
+        /// разбор завершений : файл целиком прочитан - сразу в очередь декодирования
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head)
+        {
+            io_uring_cqe &cqe = cqes[head & cq_mask];
+            unsigned slot_idx = unsigned(cqe.user_data);
+            read_slot &slot = slots[slot_idx];
+            if ( ( cqe.res == -EINTR ) or ( cqe.res == -EAGAIN ) )
+            {
+                queue_read(slot_idx);
+                continue;
+            }
+            if ( cqe.res > 0 )
+            {
+                slot.done_bytes += cqe.res;
+                if ( slot.done_bytes < int64_t(slot.job.bytes.size()) ) // короткое чтение : дочитываем остаток
+                {
+                    queue_read(slot_idx);
+                    continue;
+                }
+            }
+            else
+            {
+                slot.job.read_result = GIA_TgaErr::FileIOErr; // ошибка чтения или файл укоротился
+            }
+            ::close(slot.file_fd);
+            slot.busy = false;
+            --in_flight;
+            free_slots.push_back(slot_idx);
+            push_ready(std::move(slot.job));
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+    if ( ring_failed ) // кольцо неработоспособно : незавершённые и неначатые файлы - с ошибкой
+    {
+        /// чтения занятых слотов могут ещё идти в ядре : они отменяются, а буферы отдаются потокам только после завершения
+        /// самих чтений, иначе запоздалое чтение писало бы в уже освобождённую память
+        const uint64_t cancel_tag = uint64_t(1) << 63; // user_data записей отмены
+        size_t cancel_next = 0; // следующий слот, чьё чтение ещё не отменялось
+        while ( in_flight > 0 )
+        {
+            for(; ( cancel_next < slots.size() ) and ( *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) < params.sq_entries ); ++cancel_next)
+            {
+                if ( !slots[cancel_next].busy ) continue;
+                unsigned tail = *sq_tail;
+                io_uring_sqe &sqe = sqes[tail & sq_mask];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = IORING_OP_ASYNC_CANCEL;
+                sqe.fd = -1;
+                sqe.addr = uint64_t(cancel_next); // user_data отменяемого чтения
+                sqe.user_data = cancel_tag | cancel_next;
+                sq_array[tail & sq_mask] = tail & sq_mask;
+                __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            }
+            unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            if ( syscall(__NR_io_uring_enter, ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 )
+            {
+                if ( ( errno != EINTR ) and ( errno != EAGAIN ) and ( errno != EBUSY ) ) break; // дождаться завершений невозможно
+            }
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for(; head != tail; ++head)
+            {
+                uint64_t user_data = cqes[head & cq_mask].user_data;
+                if ( user_data & cancel_tag ) continue; // итог отмены не важен : ждём завершения самого чтения
+                read_slot &slot = slots[unsigned(user_data)];
+                if ( !slot.busy ) continue;
+                ::close(slot.file_fd);
+                slot.busy = false;
+                --in_flight;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+        for(auto &slot : slots)
+        {
+            if ( slot.job.bytes.empty() ) continue;
+            if ( slot.busy ) // завершение чтения так и не получено : буфер намеренно оставляется ядру и не освобождается
+            {
+                ::close(slot.file_fd);
+                (void)new vector<uint8_t>(std::move(slot.job.bytes));
+            }
+            slot.job.read_result = GIA_TgaErr::FileIOErr;
+            push_ready(std::move(slot.job));
+        }
+        for(; next_file < paths.size(); ++next_file) push_ready(load_job { next_file, GIA_TgaErr::FileIOErr, {} });
+    }
+    release_ring();
+
+    {
+        lock_guard<mutex> guard(ready_lock);
+        reading_done = true;
+    }
+    ready_cond.notify_all();
+    for(auto &one_worker : workers) one_worker.join();
+    return true;
+#endif
+}
+
+
+// может возвращать ошибки : Success, FileIOErr
+GIA_TgaErr GIA_TgaPackBuilder::begin(const string &pack_path)
+{
+    if ( pack_file.is_open() ) pack_file.close();
+    entries.clear();
+    names.clear();
+    pack_file.clear();
+    pack_file.open(pack_path, ios::binary | ios::trunc);
+    GIA_TgaPackHeader pack_header;
+    memset(&pack_header, 0, sizeof(pack_header)); // настоящий заголовок пишется в finish
+    pack_file.write((const char*)&pack_header, sizeof(pack_header));
+    write_pos = sizeof(pack_header);
+    is_open = bool(pack_file);
+    return is_open ? GIA_TgaErr::Success : GIA_TgaErr::FileIOErr;
+}
+
+// может возвращать ошибки : Success, InvalidHeader, FileIOErr, NotInitialized
+GIA_TgaErr GIA_TgaPackBuilder::add(const string &name, uint8_t *object_ptr, int64_t object_size)
+{
+    if ( !is_open ) return GIA_TgaErr::NotInitialized;
+    GIA_TgaDecoder decoder;
+    decoder.init(object_ptr, object_size);
+    GIA_TgaErr result = decoder.validate_header();
+    if ( result != GIA_TgaErr::ValidHeader ) return result; // объект с плохим заголовком в пак не попадает
+
+    GIA_TgaPackEntry pack_entry;
+    memset(&pack_entry, 0, sizeof(pack_entry));
+    uint64_t align_pad = ( 16 - write_pos % 16 ) % 16; // объекты выравниваются на 16 байтов
+    static const char zero_pad[16] = {};
+    pack_file.write(zero_pad, align_pad);
+    pack_entry.offset = write_pos + align_pad;
+    pack_entry.size = uint64_t(object_size);
+    memcpy(&pack_entry.header, object_ptr, sizeof(GIA_TgaHeader));
+    pack_entry.pix_data_offset = uint32_t(sizeof(GIA_TgaHeader) + pack_entry.header.id_len + pack_entry.header.cmap_type * (pack_entry.header.cmap_len * ((pack_entry.header.cmap_depth + 7) / 8)));
+    pack_file.write((const char*)object_ptr, object_size);
+    if ( !pack_file ) return GIA_TgaErr::FileIOErr;
+    write_pos = pack_entry.offset + pack_entry.size;
+    entries.push_back(pack_entry);
+    names.push_back(name);
+    return GIA_TgaErr::Success;
+}
+
+// может возвращать ошибки : Success, InvalidHeader, FileIOErr, NotInitialized
+GIA_TgaErr GIA_TgaPackBuilder::add_file(const string &path, const string &name)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    vector<uint8_t> bytes(int64_t(file.tellg()));
+    file.seekg(0);
+    file.read((char*)bytes.data(), bytes.size());
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    return add(name.empty() ? path : name, bytes.data(), bytes.size());
+}
+
+// может возвращать ошибки : Success, FileIOErr, NotInitialized
+GIA_TgaErr GIA_TgaPackBuilder::finish()
+{
+    if ( !is_open ) return GIA_TgaErr::NotInitialized;
+    is_open = false;
+    /// индекс по возрастанию имён (побайтно), объекты остаются в порядке добавления
+    vector<size_t> order(entries.size());
+    for(size_t entry_idx = 0; entry_idx < order.size(); ++entry_idx) order[entry_idx] = entry_idx;
+    stable_sort(order.begin(), order.end(), [&](size_t left, size_t right) { return names[left] < names[right]; });
+
+    uint64_t align_pad = ( 8 - write_pos % 8 ) % 8;
+    static const char zero_pad[8] = {};
+    pack_file.write(zero_pad, align_pad);
+    GIA_TgaPackHeader pack_header;
+    memcpy(pack_header.magic, "GIATPAK\x00", 8);
+    pack_header.version = 1;
+    pack_header.entry_count = uint32_t(entries.size());
+    pack_header.index_offset = write_pos + align_pad;
+    pack_header.names_size = 0;
+    for(size_t entry_idx : order)
+    {
+        GIA_TgaPackEntry &pack_entry = entries[entry_idx];
+        pack_entry.name_offset = uint32_t(pack_header.names_size);
+        pack_entry.name_len = uint32_t(names[entry_idx].size());
+        pack_header.names_size += names[entry_idx].size();
+        pack_file.write((const char*)&pack_entry, sizeof(pack_entry));
+    }
+    for(size_t entry_idx : order) pack_file.write(names[entry_idx].data(), names[entry_idx].size());
+    pack_file.seekp(0);
+    pack_file.write((const char*)&pack_header, sizeof(pack_header));
+    pack_file.close();
+    bool write_ok = !pack_file.fail();
+    entries.clear();
+    names.clear();
+    return write_ok ? GIA_TgaErr::Success : GIA_TgaErr::FileIOErr;
+}
+
+size_t GIA_TgaPackBuilder::count()
+{
+    return entries.size();
+}
+
+GIA_TgaPack::~GIA_TgaPack()
+{
+    close();
+}
+
+// может возвращать ошибки : Success, FileIOErr, InvalidHeader
+GIA_TgaErr GIA_TgaPack::open(const string &pack_path)
+{
+    close();
+#ifdef GIA_TGA_POSIX
+    int pack_fd = ::open(pack_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( pack_fd < 0 ) return GIA_TgaErr::FileIOErr;
+    struct stat pack_stat;
+    if ( fstat(pack_fd, &pack_stat) != 0 )
+    {
+        ::close(pack_fd);
+        return GIA_TgaErr::FileIOErr;
+    }
+    if ( pack_stat.st_size < int64_t(sizeof(GIA_TgaPackHeader)) ) // пустой файл не отображается, да и паком быть не может
+    {
+        ::close(pack_fd);
+        return GIA_TgaErr::InvalidHeader;
+    }
+    void *mapping = mmap(nullptr, size_t(pack_stat.st_size), PROT_READ, MAP_PRIVATE, pack_fd, 0); // страницы подгружаются по мере обращения к объектам
+    ::close(pack_fd);
+    if ( mapping == MAP_FAILED ) return GIA_TgaErr::FileIOErr;
+    pack_ptr = (uint8_t*)mapping;
+    pack_size = pack_stat.st_size;
+    is_mapped = true;
+#else
+    ifstream file(pack_path, ios::binary | ios::ate);
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    pack_bytes.resize(int64_t(file.tellg()));
+    file.seekg(0);
+    file.read((char*)pack_bytes.data(), pack_bytes.size());
+    if ( !file ) return GIA_TgaErr::FileIOErr;
+    pack_ptr = pack_bytes.data();
+    pack_size = pack_bytes.size();
+#endif
+    /// проверка заголовка и индекса : дальше записи используются без проверок
+    bool is_valid = pack_size >= int64_t(sizeof(GIA_TgaPackHeader));
+    GIA_TgaPackHeader pack_header;
+    if ( is_valid )
+    {
+        memcpy(&pack_header, pack_ptr, sizeof(pack_header));
+        is_valid = ( memcmp(pack_header.magic, "GIATPAK\x00", 8) == 0 ) and ( pack_header.version == 1 );
+    }
+    uint64_t index_size = is_valid ? uint64_t(pack_header.entry_count) * sizeof(GIA_TgaPackEntry) : 0;
+    if ( is_valid ) is_valid = ( pack_header.index_offset >= sizeof(GIA_TgaPackHeader) ) and ( pack_header.index_offset <= uint64_t(pack_size) ) and ( pack_header.index_offset % 8 == 0 )
+                               and ( index_size <= uint64_t(pack_size) - pack_header.index_offset )
+                               and ( pack_header.names_size <= uint64_t(pack_size) - pack_header.index_offset - index_size );
+    if ( is_valid )
+    {
+        index = (const GIA_TgaPackEntry*)&pack_ptr[pack_header.index_offset];
+        names = (const char*)&pack_ptr[pack_header.index_offset + index_size];
+        for(uint32_t entry_idx = 0; ( entry_idx < pack_header.entry_count ) and is_valid; ++entry_idx)
+        {
+            const GIA_TgaPackEntry &pack_entry = index[entry_idx];
+            if ( ( pack_entry.offset > uint64_t(pack_size) ) or ( pack_entry.size > uint64_t(pack_size) - pack_entry.offset ) ) is_valid = false;
+            if ( uint64_t(pack_entry.name_offset) + pack_entry.name_len > pack_header.names_size ) is_valid = false;
+        }
+    }
+    if ( !is_valid )
+    {
+        close();
+        return GIA_TgaErr::InvalidHeader;
+    }
+    entry_count = pack_header.entry_count;
+    return GIA_TgaErr::Success;
+}
+
+void GIA_TgaPack::close()
+{
+#ifdef GIA_TGA_POSIX
+    if ( is_mapped ) munmap(pack_ptr, size_t(pack_size));
+#endif
+    vector<uint8_t>().swap(pack_bytes);
+    pack_ptr = nullptr;
+    pack_size = 0;
+    is_mapped = false;
+    index = nullptr;
+    entry_count = 0;
+    names = nullptr;
+}
+
+size_t GIA_TgaPack::count()
+{
+    return entry_count;
+}
+
+int64_t GIA_TgaPack::find(const string &name)
+{
+    /// индекс отсортирован по именам : первая запись с именем не меньше искомого
+    size_t low = 0;
+    size_t high = entry_count;
+    while ( low < high )
+    {
+        size_t middle = low + ( high - low ) / 2;
+        string_view middle_name(&names[index[middle].name_offset], index[middle].name_len);
+        if ( middle_name < string_view(name) ) low = middle + 1;
+        else high = middle;
+    }
+    if ( ( low < entry_count ) and ( string_view(&names[index[low].name_offset], index[low].name_len) == name ) ) return int64_t(low);
+    return -1;
+}
+
+string GIA_TgaPack::name(size_t entry_idx)
+{
+    if ( entry_idx >= entry_count ) return string();
+    return string(&names[index[entry_idx].name_offset], index[entry_idx].name_len);
+}
+
+const GIA_TgaPackEntry* GIA_TgaPack::entry(size_t entry_idx)
+{
+    return ( entry_idx < entry_count ) ? &index[entry_idx] : nullptr;
+}
+
+uint8_t* GIA_TgaPack::object(size_t entry_idx)
+{
+    return ( entry_idx < entry_count ) ? &pack_ptr[index[entry_idx].offset] : nullptr;
+}
+
+// может возвращать ошибки : ValidHeader, InvalidHeader
+GIA_TgaErr GIA_TgaPack::init_decoder(GIA_TgaDecoder &decoder, size_t entry_idx)
+{
+    if ( entry_idx >= entry_count ) return GIA_TgaErr::InvalidHeader;
+    return decoder.init(&pack_ptr[index[entry_idx].offset], int64_t(index[entry_idx].size), index[entry_idx]);
+}
+
+
+GIA_TgaDiskCache::GIA_TgaDiskCache(const string &directory, int64_t max_bytes)
+{
+    cache_dir = directory;
+    budget_bytes = max_bytes;
+    error_code fs_err;
+    filesystem::create_directories(cache_dir, fs_err); // ошибка не фатальна : без каталога кэш просто не сохраняет результаты
+    used_estimate = used_bytes();
+}
+
+string GIA_TgaDiskCache::entry_path(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.gtc", (unsigned long long)key);
+    return ( filesystem::path(cache_dir) / name ).string();
+}
+
+// может возвращать ошибки : Success, TruncDataAbort, TooMuchPixAbort (итог исходного decode), FileIOErr
+GIA_TgaMappedImage GIA_TgaDiskCache::map_entry(const string &path, uint64_t key)
+{
+    GIA_TgaMappedImage image { 0, 0, 0, GIA_TgaErr::FileIOErr, nullptr };
+    const uint8_t *entry_ptr = nullptr;
+    int64_t entry_size = 0;
+#ifdef GIA_TGA_POSIX
+    int entry_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if ( entry_fd < 0 ) return image;
+    struct stat entry_stat;
+    if ( ( fstat(entry_fd, &entry_stat) != 0 ) or ( entry_stat.st_size < int64_t(sizeof(GIA_TgaDiskCacheHeader)) ) )
+    {
+        ::close(entry_fd);
+        return image;
+    }
+    entry_size = entry_stat.st_size;
+    void *mapping = mmap(nullptr, size_t(entry_size), PROT_READ, MAP_SHARED, entry_fd, 0);
+    ::close(entry_fd);
+    if ( mapping == MAP_FAILED ) return image;
+    entry_ptr = (const uint8_t*)mapping;
+    shared_ptr<const uint8_t> holder(entry_ptr, [entry_size](const uint8_t *ptr) { munmap((void*)ptr, size_t(entry_size)); });
+#else
+    ifstream file(path, ios::binary | ios::ate);
+    if ( !file ) return image;
+    entry_size = int64_t(file.tellg());
+    if ( entry_size < int64_t(sizeof(GIA_TgaDiskCacheHeader)) ) return image;
+    auto entry_bytes = make_shared<vector<uint8_t>>(entry_size);
+    file.seekg(0);
+    file.read((char*)entry_bytes->data(), entry_size);
+    if ( !file ) return image;
+    entry_ptr = entry_bytes->data();
+    shared_ptr<const uint8_t> holder(entry_bytes, entry_ptr);
+#endif
+    GIA_TgaDiskCacheHeader entry_header;
+    memcpy(&entry_header, entry_ptr, sizeof(entry_header));
+    bool is_valid = ( memcmp(entry_header.magic, "GIATDC1\x00", 8) == 0 ) and ( entry_header.key == key )
+                    and ( entry_header.bytes_per_line == uint64_t(entry_header.width) * 4 )
+                    and ( uint64_t(entry_size) - sizeof(entry_header) == entry_header.bytes_per_line * entry_header.height ); // файл, оборванный при записи, не подходит
+    if ( !is_valid ) return image;
+    image.width = int(entry_header.width);
+    image.height = int(entry_header.height);
+    image.bytes_per_line = int64_t(entry_header.bytes_per_line);
+    image.result = GIA_TgaErr(entry_header.result);
+    image.data = shared_ptr<const uint8_t>(holder, &entry_ptr[sizeof(entry_header)]); // указатель на пиксели держит всё отображение
+    return image;
+}
+
+// может возвращать ошибки : Success, TruncDataAbort, TooMuchPixAbort, InvalidHeader, MemAllocErr, FileIOErr
+GIA_TgaMappedImage GIA_TgaDiskCache::load(const string &path)
+{
+    GIA_TgaMappedImage image { 0, 0, 0, GIA_TgaErr::FileIOErr, nullptr };
+    /// ключ : путь и время изменения задают затравку хеша содержимого
+    error_code fs_err;
+    auto mtime = filesystem::last_write_time(path, fs_err);
+    if ( fs_err ) return image;
+    ifstream file(path, ios::binary | ios::ate);
+    if ( !file ) return image;
+    vector<uint8_t> src(int64_t(file.tellg()));
+    file.seekg(0);
+    file.read((char*)src.data(), src.size());
+    if ( !file ) return image;
+    int64_t mtime_count = int64_t(mtime.time_since_epoch().count());
+    uint64_t seed = GIA_TgaCache::content_hash((const uint8_t*)path.data(), path.size(), uint64_t(mtime_count));
+    uint64_t key = GIA_TgaCache::content_hash(src.data(), src.size(), seed);
+    string cached_path = entry_path(key);
+
+    /// попадание : отображение файла кэша, его время изменения служит отметкой LRU
+    image = map_entry(cached_path, key);
+    if ( image.data != nullptr )
+    {
+        filesystem::last_write_time(cached_path, filesystem::file_time_type::clock::now(), fs_err);
+        return image;
+    }
+
+    /// промах : декодирование и запись во временный файл, который затем атомарно переименовывается
+    GIA_TgaErr result;
+    auto decoded = GIA_TgaCache::decode_image(src.data(), src.size(), &result);
+    image.result = result;
+    if ( decoded == nullptr ) return image;
+    vector<uint8_t>().swap(src);
+    GIA_TgaDiskCacheHeader entry_header;
+    memset(&entry_header, 0, sizeof(entry_header));
+    memcpy(entry_header.magic, "GIATDC1\x00", 8);
+    entry_header.key = key;
+    entry_header.width = uint32_t(decoded->width);
+    entry_header.height = uint32_t(decoded->height);
+    entry_header.bytes_per_line = uint64_t(decoded->bytes_per_line);
+    entry_header.result = uint32_t(decoded->result);
+    string temp_path = cached_path + ".tmp" + to_string(hash<thread::id>()(this_thread::get_id()) ^ uint64_t(chrono::steady_clock::now().time_since_epoch().count()));
+    ofstream entry_file(temp_path, ios::binary | ios::trunc);
+    entry_file.write((const char*)&entry_header, sizeof(entry_header));
+    entry_file.write((const char*)decoded->data.data(), decoded->data.size());
+    entry_file.close();
+    if ( !entry_file.fail() ) filesystem::rename(temp_path, cached_path, fs_err);
+    if ( entry_file.fail() or fs_err ) // каталог недоступен или диск заполнен : изображение отдаётся из памяти
+    {
+        filesystem::remove(temp_path, fs_err);
+        image.width = decoded->width;
+        image.height = decoded->height;
+        image.bytes_per_line = decoded->bytes_per_line;
+        image.data = shared_ptr<const uint8_t>(decoded, decoded->data.data());
+        return image;
+    }
+    if ( ( used_estimate += int64_t(sizeof(entry_header) + decoded->data.size()) ) > budget_bytes ) trim();
+    image = map_entry(cached_path, key);
+    if ( image.data == nullptr ) // файл успели вытеснить или заменить : изображение отдаётся из памяти
+    {
+        image = GIA_TgaMappedImage { decoded->width, decoded->height, decoded->bytes_per_line, decoded->result, shared_ptr<const uint8_t>(decoded, decoded->data.data()) };
+    }
+    return image;
+}
+
+void GIA_TgaDiskCache::trim()
+{
+    lock_guard<mutex> guard(trim_lock);
+    struct cache_file
+    {
+        filesystem::path path;
+        filesystem::file_time_type mtime;
+        int64_t size;
+    };
+    vector<cache_file> files;
+    int64_t total = 0;
+    error_code fs_err;
+    for(auto it = filesystem::directory_iterator(cache_dir, fs_err); !fs_err and ( it != filesystem::directory_iterator() ); it.increment(fs_err))
+    {
+        if ( it->path().extension() != ".gtc" ) continue;
+        error_code file_err;
+        cache_file one_file { it->path(), it->last_write_time(file_err), int64_t(it->file_size(file_err)) };
+        if ( file_err ) continue;
+        files.push_back(one_file);
+        total += one_file.size;
+    }
+    sort(files.begin(), files.end(), [](const cache_file &left, const cache_file &right) { return left.mtime < right.mtime; }); // в начале - давно неиспользованные
+    for(size_t file_idx = 0; ( file_idx < files.size() ) and ( total > budget_bytes ); ++file_idx)
+    {
+        if ( filesystem::remove(files[file_idx].path, fs_err) ) total -= files[file_idx].size; // отображённые изображения остаются доступны (POSIX)
+    }
+    used_estimate = total;
+}
+
+void GIA_TgaDiskCache::clear()
+{
+    lock_guard<mutex> guard(trim_lock);
+    error_code fs_err;
+    vector<filesystem::path> files;
+    for(auto it = filesystem::directory_iterator(cache_dir, fs_err); !fs_err and ( it != filesystem::directory_iterator() ); it.increment(fs_err))
+    {
+        if ( it->path().extension() == ".gtc" ) files.push_back(it->path());
+    }
+    for(auto &one_file : files) filesystem::remove(one_file, fs_err);
+    used_estimate = 0;
+}
+
+int64_t GIA_TgaDiskCache::used_bytes()
+{
+    int64_t total = 0;
+    error_code fs_err;
+    for(auto it = filesystem::directory_iterator(cache_dir, fs_err); !fs_err and ( it != filesystem::directory_iterator() ); it.increment(fs_err))
+    {
+        if ( it->path().extension() != ".gtc" ) continue;
+        error_code file_err;
+        uintmax_t file_size = it->file_size(file_err);
+        if ( !file_err ) total += int64_t(file_size);
+    }
+    return total;
+}
+
 }
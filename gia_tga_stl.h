@@ -5,18 +5,58 @@
 #include <cstdint>
 #include <string>
 #include <set>
+#include <functional>
+#include <fstream>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
 
 namespace gia_tga_stl
 {
 using namespace std;
 enum class GIA_TgaErr: size_t { InvalidHeader = 0, ValidHeader = 1, TruncDataAbort = 2, TooMuchPixAbort      = 3,
                                 Success       = 4, MemAllocErr = 5, NotInitialized = 6, NeedHeaderValidation = 7,
-                                NeedDecoding  = 8 };
+                                NeedDecoding  = 8, NoPostageStamp = 9, SmallBuffer = 10, InvalidRegion = 11,
+                                Cancelled     = 12, BudgetExceeded = 13, FileIOErr = 14, InvalidIndex = 15 };
 
 enum class GIA_TgaOrigin: uint8_t { TopLeft    = 0b00100000,    TopRight = 0b00110000,
                                     BottomLeft = 0b00000000, BottomRight = 0b00010000,
                                     Unknown    = 0b11111111 // значение при невалидированном заголовке
                                     };
+
+enum class GIA_TgaMipFilter: uint8_t { None    = 0, // цепочка мип-уровней не строится
+                                       Box     = 1, // усреднение 2x2 непосредственно по значениям каналов
+                                       BoxSRGB = 2  // усреднение 2x2 в линейном свете (корректно для sRGB-текстур)
+                                       };
+
+enum class GIA_TgaLayout: uint8_t { Linear = 0, // сканлинии подряд
+                                    Tiled  = 1, // квадратные плитки подряд, внутри плитки - сканлинии
+                                    Morton = 2  // квадратные плитки подряд, внутри плитки - Z-порядок (Morton)
+                                    };
+
+enum class GIA_TgaBcFormat: uint8_t { BC1 = 1, // 8 байтов на блок 4x4 : цвет 5:6:5 и однобитная альфа
+                                      BC3 = 3  // 16 байтов на блок 4x4 : цвет как у BC1 и интерполированная альфа
+                                      };
+
+enum class GIA_TgaFloatFormat: uint8_t { None    = 0, // выдача BB GG RR AA по байту на канал
+                                         RGBA32F = 1, // R G B A по float на канал (16 байтов на пиксель)
+                                         RGBA16F = 2  // R G B A по half (IEEE 754 binary16) на канал (8 байтов на пиксель)
+                                         };
+
+enum class GIA_TgaKeyColor: uint8_t { None     = 0, // цветовой ключ не применяется
+                                      FromFile = 1, // key_color из области расширений TGA 2.0 (без области ключ не применяется)
+                                      Custom   = 2  // цвет, переданный в set_key_color
+                                      };
+
+enum class GIA_TgaAlphaKind: uint8_t { Unknown     = 0, // изображение ещё не декодировано
+                                       Opaque      = 1, // вся альфа равна 255
+                                       Binary      = 2, // альфа принимает только значения 0 и 255
+                                       Translucent = 3  // есть промежуточные значения, нужно смешивание
+                                       };
 #pragma pack(push,1)
 struct GIA_TgaHeader
 {
@@ -33,6 +73,37 @@ struct GIA_TgaHeader
     uint8_t  pix_depth;
     uint8_t  img_descr;
 };
+struct GIA_TgaPackHeader // заголовок файла пака .tgapak (все поля little-endian)
+{
+    char     magic[8]; // "GIATPAK\0"
+    uint32_t version; // 1
+    uint32_t entry_count;
+    uint64_t index_offset; // смещение индекса : entry_count записей GIA_TgaPackEntry, за ними - таблица имён
+    uint64_t names_size; // размер таблицы имён в байтах
+};
+struct GIA_TgaPackEntry // запись индекса пака : место объекта и готовые итоги validate_header
+{
+    uint64_t offset; // смещение объекта от начала пака
+    uint64_t size; // размер объекта в байтах
+    uint32_t name_offset; // смещение имени в таблице имён (UTF-8, без завершающего нуля)
+    uint32_t name_len;
+    uint32_t pix_data_offset; // смещение пиксельных данных внутри объекта
+    GIA_TgaHeader header; // копия проверенного заголовка : размеры, тип, origin, палитра
+    uint8_t  reserved[2];
+};
+struct GIA_TgaRleIndexHeader // заголовок индекса rle-пакетов (build_rle_index), за ним entry_count записей GIA_TgaRleIndexEntry
+{
+    char     magic[8]; // "GIATRI1\0"
+    GIA_TgaHeader header; // копия заголовка объекта, для которого построен индекс
+    uint64_t pix_data_size; // размер пиксельных данных объекта (от pix_data_offset до конца)
+    uint32_t rows_step; // шаг индекса в сканлиниях
+    uint32_t entry_count;
+};
+struct GIA_TgaRleIndexEntry // место начала сканлинии entry_idx * rows_step (в порядке файла)
+{
+    uint64_t src_idx; // смещение заголовка пакета, в котором начинается сканлиния, от начала пиксельных данных
+    uint8_t  packet_done; // сколько пикселей этого пакета относится к предыдущим сканлиниям
+};
 struct GIA_TgaExtInfo
 {
     string   author;
@@ -74,6 +145,65 @@ struct GIA_TgaInfo
 };
 #pragma pack(pop)
 
+struct GIA_TgaStamp
+{
+    int width;
+    int height;
+    int64_t bytes_per_line;
+    vector<uint8_t> data; // пиксели в формате BB GG RR AA, уже приведённые к TopLeft
+};
+
+struct GIA_TgaMipLevel
+{
+    int width;
+    int height;
+    int64_t bytes_per_line; // размер сканлинии уровня в байтах
+    int64_t offset; // смещение уровня от начала массива data()
+};
+
+struct GIA_TgaAlpha
+{
+    GIA_TgaAlphaKind kind;
+    uint8_t min; // минимальная альфа
+    uint8_t max; // максимальная альфа
+};
+
+struct GIA_TgaStats // статистика выдаваемых пикселей, собранная ядрами decode (set_stats)
+{
+    int64_t pixels; // учтённых пикселей (у прерванного декодирования - только раскодированные)
+    uint64_t histogram[4][256]; // гистограммы каналов BB, GG, RR, AA
+    uint8_t min[4]; // минимальные значения каналов BB, GG, RR, AA
+    uint8_t max[4]; // максимальные значения каналов
+    double mean[4]; // средние значения каналов
+};
+
+struct GIA_TgaTileInfo
+{
+    GIA_TgaLayout layout;
+    int tile_size; // сторона плитки в пикселях (0 у Linear)
+    int tiles_x; // плиток по горизонтали
+    int tiles_y; // плиток по вертикали
+    int64_t tile_bytes; // размер плитки в байтах; плитки идут подряд рядами слева направо, сверху вниз
+    int64_t total_size; // размер массива данных вместе с полями краевых плиток
+};
+
+struct GIA_TgaShmImage
+{
+    int fd; // дескриптор memfd (или объекта shm_open, уже удалённого из пространства имён); -1 - нет
+    int64_t size; // размер объекта в байтах
+    int width;
+    int height;
+    int64_t bytes_per_line; // размер сканлинии в байтах (у плиток - ширина изображения * 4)
+    GIA_TgaLayout layout;
+    int tile_size; // сторона плитки при Tiled/Morton (0 у Linear)
+    GIA_TgaFloatFormat float_format; // None - BB GG RR AA, иначе R G B A во float/half
+    bool premultiplied; // каналы цвета умножены на альфу
+    bool sealed; // установлены F_SEAL_WRITE, F_SEAL_SHRINK, F_SEAL_GROW и F_SEAL_SEAL : содержимое больше не меняется
+};
+
+using GIA_TgaProgress = std::function<bool(int rows_done, int rows_total)>; // возврат false отменяет декодирование
+using GIA_TgaRowSink = std::function<bool(int first_row, int row_count, const uint8_t *pixels, int64_t bytes_per_line)>; // полоса сканлиний в нормальной ориентации; возврат false отменяет декодирование
+
 
 class GIA_TgaDecoder
 {
@@ -126,6 +256,14 @@ class GIA_TgaDecoder
         uint8_t  attr_type;
     };
 #pragma pack(pop)
+    struct row_reader // состояние последовательного чтения исходных пикселей, в том числе сквозь границы rle-пакетов
+    {
+        int64_t src_idx; // byte index in pixel data
+        int64_t src_end; // pixel data size (from pix_data_offset to the end of source file)
+        int64_t packet_left; // сколько пикселей текущего пакета ещё не прочитано
+        bool is_rle_packet; // текущий пакет - rle-группа
+        uint32_t rle_value; // раскодированный пиксель rle-группы
+    };
 private:
     enum class FSM_States: size_t { NotInitialized, Initialized, HeaderValidated, InvalidHeader, DecodedOK, DecodingAbort, NotEnoughMem };
     static const vector<string> err_strings;
@@ -135,11 +273,19 @@ private:
     uint8_t *src_array;
     size_t src_size;
     GIA_TgaHeader *header;
+    GIA_TgaHeader header_copy; // заголовок из индекса пака (init с записью GIA_TgaPackEntry)
     int64_t pix_data_offset;
     uint8_t *dst_array; // указатель не раскодированные данные
     int64_t total_size_p; // полный ожидаемый размер раскодированных данных в пикселях
     int64_t total_size_b; // полный ожидаемый размер раскодированных данных в байтах
     bool is_data_detached;
+    uint8_t *ext_dst_array; // буфер вызывающего для следующего декодирования (set_dst_buffer)
+    int64_t ext_dst_size; // размер буфера вызывающего в байтах
+    bool is_dst_external; // dst_array - буфер вызывающего (не освобождается, но flip с ним работает)
+    uint8_t *own_array; // собственный массив объекта : dst_array указывает на него, если данные не внешние и не отсоединены
+    int64_t own_capacity; // размер own_array в байтах
+    int64_t own_used; // байтов own_array занято текущим изображением (0 - изображения нет)
+    bool reuse_dst; // init и decode оставляют own_array для следующего изображения (set_dst_reuse)
     uint16_t width;
     uint16_t height;
     int64_t bytes_per_line;
@@ -149,11 +295,66 @@ private:
     uint8_t cmap_elem_depth; // размер элемента палитры в битах
     uint8_t cmap_elem_size; // размер элемента палитры в байтах
     uint16_t cmap_len; // количество элементов в палитре (от 1 до 256)
+    uint16_t cmap_first; // индекс первого элемента палитры (cmap_start из заголовка)
     uint8_t alpha_bits; // количество бит альфа-канала
     int8_t image_type;
     FSM_States state;
     bbggrraa *color_map;
     int64_t cmap_offset;
+    GIA_TgaMipFilter mip_filter; // фильтр цепочки мип-уровней (None - цепочка не строится)
+    bool use_color_correction; // применять таблицу цветовой коррекции и гамму из области расширений TGA 2.0
+    bool pp_active; // включена хотя бы одна попиксельная обработка (выполняется внутри ядер декодирования)
+    bool luts_active; // таблицы каналов channel_lut не тождественные
+    uint8_t channel_lut[4][256]; // таблицы перевода каналов BB, GG, RR, AA
+    bool premultiply; // выдавать каналы цвета, умноженные на альфу
+    GIA_TgaKeyColor key_mode; // источник цветового ключа
+    uint32_t key_custom; // цвет ключа вызывающего (GIA_TgaKeyColor::Custom)
+    bool key_active; // цветовой ключ применяется в текущем декодировании
+    uint32_t key_rgb; // байты цвета ключа 0x00RRGGBB текущего декодирования
+    GIA_TgaFloatFormat float_format; // формат выдачи decode и decode_rows
+    bool float_linear; // при переводе во float цвет переводится из sRGB в линейный свет
+    bool pm_float; // умножение на альфу выполняется при переводе во float (в линейном свете), а не над байтами
+    bool square_pixels; // decode и decode_rows выдают квадратные пиксели (set_square_pixels)
+    bool aspect_active; // текущее декодирование передискретизирует сканлинии по pix_numer/pix_denom
+    int aspect_width; // ширина сканлинии после передискретизации
+    int aspect_taps; // весов на выходной пиксель (чётное : SSE2 берёт исходные пиксели парами)
+    vector<int32_t> aspect_start; // первый исходный пиксель окна каждого выходного пикселя
+    vector<int16_t> aspect_weights; // веса окон в фиксированной точке 2.14 (сумма окна - 16384)
+    bool pm_active; // умножение на альфу требуется (альфа не является заведомо непрозрачной)
+    bool alpha_collect; // текущее декодирование собирает сведения об альфе (миниатюра их не трогает)
+    bool alpha_scan; // сведения об альфе собираются ядрами по пикселям (иначе ответ известен по заголовку или палитре)
+    uint8_t alpha_lo; // минимальная встреченная альфа
+    uint8_t alpha_hi; // максимальная встреченная альфа
+    bool alpha_partial; // встречались значения альфы, отличные от 0 и 255
+    bool stats_enabled; // decode собирает статистику пикселей (set_stats)
+    bool stats_scan; // текущее декодирование собирает статистику
+    bool stats_collected; // статистика последнего декодирования собрана
+    uint32_t stats_hist[2][4][256]; // гистограммы каналов, накопленные ядрами : чётные и нечётные пиксели порознь (32 бита хватает на 65535 x 65535)
+    uint64_t stats_index[256]; // счётчики индексов палитровых изображений (цвета добавляются в stats по палитре)
+    uint32_t stats_palette[256]; // обработанная палитра для stats_index
+    int16_t stats_alpha; // альфа, заведомо одинаковая у всех пикселей (её гистограмма не ведётся по пикселям), -1 - альфа сканируется
+    GIA_TgaProgress progress_cb; // обратный вызов прогресса по полосам сканлиний
+    int ctl_band_rows; // высота полосы сканлиний между вызовами progress_cb
+    int64_t ctl_band_pix; // размер полосы в исходных пикселях
+    int64_t ctl_next_band; // число исходных пикселей, после которого вызывается progress_cb
+    int64_t ctl_next_pix; // число исходных пикселей, после которого ядро вызывает band_done (INT64_MAX - контроль выключен)
+    int64_t ctl_total_pix; // исходных пикселей всего
+    bool ctl_each_row; // отмена и бюджеты проверяются на каждой сканлинии
+    GIA_TgaErr ctl_stop; // причина прерывания : Cancelled, BudgetExceeded (Success - декодирование не прерывалось)
+    int64_t pixel_budget; // предельное число исходных пикселей за одно декодирование (0 - без предела)
+    std::chrono::milliseconds time_budget; // предельное время одного декодирования (0 - без предела)
+    std::chrono::steady_clock::time_point ctl_deadline; // момент исчерпания time_budget текущего декодирования
+    const std::atomic<bool> *cancel_token; // внешний флаг отмены (true - прервать)
+    uint16_t ctl_width; // исходные размеры изображения для отчёта о прогрессе
+    uint16_t ctl_height;
+    vector<GIA_TgaMipLevel> mip_chain; // уровни цепочки, нулевой - само изображение
+    GIA_TgaLayout layout; // раскладка пикселей, которую выдаёт decode
+    int tile_shift; // log2 стороны плитки
+    bool is_dst_tiled; // dst_array разложен по плиткам (уже в ориентации TopLeft, flip не нужен)
+    bool is_dst_compressed; // dst_array содержит блоки BC1/BC3 (уже в ориентации TopLeft, flip не нужен)
+    bool is_dst_converted; // dst_array собран decode_converted : float/half и/или квадратные пиксели (уже в ориентации TopLeft, flip не нужен)
+    vector<GIA_TgaRleIndexEntry> rle_index; // индекс rle-пакетов (build_rle_index, load_rle_index), пуст - индекса нет
+    int rle_index_step; // шаг индекса в сканлиниях
     string id_string;
 private:
     GIA_TgaErr create_cmap_256();
@@ -169,11 +370,41 @@ private:
     GIA_TgaErr decode_tc_rle16();
     GIA_TgaErr decode_tc_rle24();
     GIA_TgaErr decode_tc_rle32();
+    GIA_TgaErr decode_tiled(); // decode с раскладкой по плиткам
+    GIA_TgaErr decode_converted(); // decode с переводом каждой сканлинии : квадратные пиксели и/или float/half
+    int64_t float_pix_size(); // размер выдаваемого пикселя в байтах (4 без перевода во float)
+    int64_t decode_size(); // размер массива, который выдаст decode при текущих настройках
+    void convert_row_float(const uint32_t *src, uint8_t *dst, int64_t count); // BB GG RR AA -> R G B A float/half по таблицам из 256 элементов
+    bool prepare_aspect(); // готовит веса передискретизации до квадратных пикселей; false - она не нужна
+    void resample_row(const uint32_t *src, uint32_t *dst); // горизонтальная передискретизация сканлинии по готовым весам
+    void convert_row(uint32_t *row, uint32_t *aspect_row, uint8_t *dst); // передискретизация и/или перевод во float раскодированной сканлинии
+    static uint32_t spread_bits(uint32_t value); // 0b abcd -> 0b 0a0b0c0d, половина кода Morton
+    static void encode_bc_block(const uint32_t *block, GIA_TgaBcFormat format, uint8_t *dst); // сжатие блока 4x4 в BC1/BC3
+    static void encode_bc3_alpha(const uint32_t *block, uint8_t min_alpha, uint8_t max_alpha, uint8_t *dst); // альфа-блок BC3
     void fill_with_dword(uint32_t value, void *dst_start, uint8_t count);
     void fill_with_zeroes();
-    void flip_dia(); // переворачивает BottomRight к TopLeft (diagonal flip)
-    void flip_ver(); // переворачивает BottomLeft к TopLeft (vertical flip)
-    void flip_hor(); // переворачивает TopRight к TopLeft (horizontal flip)
+    extensions_area* find_ext_area(); // область расширений TGA 2.0 или nullptr
+    void reader_start(row_reader &reader); // установка на начало пиксельных данных
+    GIA_TgaErr reader_seek(row_reader &reader, int64_t scln, int64_t scln_width); // установка на начало сканлинии scln (в порядке файла) с помощью индекса rle-пакетов
+    void convert_pixels(const uint8_t *src, uint32_t *dst, int64_t count); // перевод count исходных пикселей в формат 0xAARRGGBB
+    GIA_TgaErr read_pixels(row_reader &reader, uint32_t *dst, int64_t count); // читает очередные count пикселей в dst (при dst == nullptr пропускает их)
+    bool is_alpha_opaque(); // альфа исходных пикселей заведомо равна 0xFF (определяется по заголовку, без сканирования)
+    void prepare_pixel_ops(bool collect_alpha, bool float_out = false, bool collect_stats = false); // готовит попиксельные обработки перед декодированием
+    GIA_TgaErr alloc_dst(int64_t alloc_size); // выделяет dst_array (или переиспользует own_array) либо берёт под него буфер вызывающего
+    void release_dst(); // отпускает dst_array : собственный массив освобождается либо остаётся для следующего изображения
+    void reset_dims(); // восстанавливает размеры изображения из заголовка
+    bool band_done(int64_t pix_done); // граница сканлинии/полосы : прогресс, отмена, бюджеты; false - прервать с кодом ctl_stop
+    void scan_alpha(const uint32_t *pixels, int64_t count); // накапливает min/max альфы и признак промежуточных значений
+    void premultiply_pixels(uint32_t *pixels, int64_t count); // умножение каналов цвета на альфу с точным делением на 255
+    void mask_key_color(uint32_t *pixels, int64_t count); // пиксели цвета key_rgb заменяются прозрачным чёрным
+    void add_stats(const uint32_t *pixels, int64_t count, uint64_t weight); // добавляет пиксели в гистограммы, каждый weight раз
+    void process_pixels(uint32_t *pixels, int64_t count, uint64_t weight = 1); // попиксельные обработки, вызываются ядрами по ещё горячим данным; weight - вес пикселя в статистике
+    int64_t mip_chain_size(); // размер всех мип-уровней кроме нулевого в байтах
+    void build_mipmaps(); // строит мип-уровни в dst_array сразу за изображением
+    void reduce_level(const GIA_TgaMipLevel &src_lvl, const GIA_TgaMipLevel &dst_lvl, bool skip_first_col, bool skip_first_row);
+    void flip_dia(uint32_t *array, int64_t pix_count); // переворачивает BottomRight к TopLeft (diagonal flip)
+    void flip_ver(uint32_t *array, int64_t flip_width, int64_t flip_height); // переворачивает BottomLeft к TopLeft (vertical flip)
+    void flip_hor(uint32_t *array, int64_t flip_width, int64_t flip_height); // переворачивает TopRight к TopLeft (horizontal flip)
 public:
     GIA_TgaDecoder();
     GIA_TgaDecoder(const GIA_TgaDecoder&) = delete;
@@ -181,13 +412,207 @@ public:
     ~GIA_TgaDecoder();
 
     void init(uint8_t *object_ptr, int64_t object_size); // обязательная начальная инициализация
-    GIA_TgaErr validate_header(uint16_t max_width = 8192, uint16_t max_height = 16384); // проверяет заголовок объекта на корректность
+    GIA_TgaErr init(uint8_t *object_ptr, int64_t object_size, const GIA_TgaPackEntry &entry); // инициализация с заголовком из индекса пака вместо validate_header
+    GIA_TgaErr validate_header(uint16_t max_width = 65535, uint16_t max_height = 65535); // проверяет заголовок объекта на корректность
     GIA_TgaErr decode(); // выделяет память и декодирует в неё объект
+    GIA_TgaErr decode_scaled(uint8_t factor); // декодирует с уменьшением в factor раз по каждой стороне без полноразмерного буфера
+    std::future<GIA_TgaErr> decode_async(); // decode в отдельном потоке; до готовности результата объект использовать нельзя
+    GIA_TgaErr decode_region(int x, int y, int region_width, int region_height); // декодирует только прямоугольную область изображения
+    GIA_TgaErr decode_rows(GIA_TgaRowSink sink, int band_rows = 64); // потоковое декодирование полосами сканлиний без полноразмерного буфера
+    GIA_TgaErr decode_to_file(const string &path, int band_rows = 64); // потоковое декодирование в файл сырых пикселей BB GG RR AA (TopLeft)
+    GIA_TgaErr decode_to_shm(GIA_TgaShmImage &image, bool seal = true); // decode в memfd/shm для передачи другому процессу без копирования
+    GIA_TgaErr recompress_rle(vector<uint8_t> &result); // перепаковывает объект без потерь в оптимальный rle-тип 9/10/11
+    GIA_TgaErr build_rle_index(vector<uint8_t> &index, int rows_step = 16); // строит индекс rle-пакетов для decode_region и выдаёт его для сохранения
+    GIA_TgaErr load_rle_index(const vector<uint8_t> &index); // подключает сохранённый индекс rle-пакетов
+    void set_dst_buffer(uint8_t *buffer, int64_t buffer_size); // следующее декодирование пишет в буфер вызывающего вместо dst_array
+    void set_dst_reuse(bool enable); // init и decode сохраняют собственный массив и переиспользуют его, если новое изображение помещается
+    GIA_TgaErr reserve(int64_t new_capacity); // заранее выделяет собственный массив не меньше new_capacity байтов
+    void shrink_to_fit(); // уменьшает собственный массив до размера текущего изображения (без изображения - освобождает)
+    int64_t capacity(); // размер собственного массива в байтах
+    void set_progress(GIA_TgaProgress callback, int band_rows = 64); // прогресс по полосам из band_rows сканлиний и возможность отмены
+    void set_cancel_token(const std::atomic<bool> *token); // внешний флаг отмены, проверяется на каждой сканлинии (nullptr - без флага)
+    void set_budget(std::chrono::milliseconds time_limit, int64_t pixel_limit = 0); // пределы времени и пикселей на одно декодирование (0 - без предела)
     const string& err_str(GIA_TgaErr err_code); // возвращает строковую расшифровку ошибки
     GIA_TgaErr detach_data(); // отсоединяет от себя указатель на dst_array
     uint8_t* data(); // возвращает указатель на dst_array
     GIA_TgaInfo info(); // возвращает свойства tga-объекта
+    GIA_TgaErr decode_postage_stamp(GIA_TgaStamp &stamp); // декодирует встроенную миниатюру (postage stamp) без обращения к основным пиксельным данным
     void flip(); // переворачивает изображение к нормальному, если origin отличается от TopLeft
+    void set_mipmaps(GIA_TgaMipFilter filter); // включает построение цепочки мип-уровней при decode
+    GIA_TgaErr decode_bc(GIA_TgaBcFormat format); // транскодирование в блоки BC1/BC3 полосами по 4 сканлинии, без полноразмерного буфера
+    int64_t bc_size(GIA_TgaBcFormat format); // размер массива блоков BC1/BC3 в байтах
+    void set_layout(GIA_TgaLayout new_layout, int tile_size = 64); // раскладка пикселей decode : сканлинии, плитки или плитки с Z-порядком
+    GIA_TgaTileInfo tile_info(); // геометрия плиток для текущих размеров и раскладки
+    uint8_t* tile(int tile_x, int tile_y); // указатель на плитку внутри data() (nullptr вне диапазона или без плиток)
+    int64_t pixel_offset(int x, int y); // смещение пикселя нормально ориентированного изображения от начала data() в байтах
+    void set_color_correction(bool enable); // включает применение таблицы цветовой коррекции и гаммы TGA 2.0 при декодировании
+    void set_premultiplied(bool enable); // включает выдачу пикселей с каналами цвета, умноженными на альфу
+    void set_key_color(GIA_TgaKeyColor mode, uint32_t color = 0); // пиксели цвета ключа (0xRRGGBB, альфа не сравнивается) становятся прозрачными
+    void set_float_output(GIA_TgaFloatFormat format, bool linear = true); // decode и decode_rows выдают R G B A во float/half, linear - перевод цвета из sRGB в линейный свет
+    void set_square_pixels(bool enable); // decode и decode_rows растягивают/сжимают сканлинии до квадратных пикселей по pix_numer/pix_denom
+    const vector<GIA_TgaMipLevel>& mip_levels(); // уровни цепочки с их смещениями внутри data()
+    GIA_TgaAlpha alpha_info(); // классификация альфа-канала, собранная во время decode/decode_scaled
+    void set_stats(bool enable); // decode собирает гистограммы, min/max и средние каналов внутри ядер декодирования
+    GIA_TgaStats stats(); // статистика последнего decode (pixels == 0 - не собиралась)
+};
+
+struct GIA_TgaImage // декодированное изображение, которое кэш раздаёт потребителям; не меняется после создания
+{
+    int width;
+    int height;
+    int64_t bytes_per_line;
+    GIA_TgaErr result; // итог decode : Success, TruncDataAbort или TooMuchPixAbort
+    vector<uint8_t> data; // пиксели в формате BB GG RR AA, уже приведённые к TopLeft
+};
+
+// кэш декодированных изображений по хешу содержимого исходного объекта; потокобезопасен
+class GIA_TgaCache
+{
+    struct cache_entry
+    {
+        uint64_t hash; // хеш исходного объекта
+        uint64_t check; // второй хеш с другим зерном : одного совпадения hash для попадания мало
+        int64_t src_size; // размер исходного объекта
+        shared_ptr<const GIA_TgaImage> image;
+    };
+    struct cache_shard // шард со своей блокировкой, списком LRU и индексом
+    {
+        mutex lock;
+        list<cache_entry> lru; // в начале - недавно использованные
+        unordered_multimap<uint64_t, list<cache_entry>::iterator> index;
+        int64_t used_bytes = 0;
+    };
+    vector<unique_ptr<cache_shard>> shards;
+    int64_t shard_budget; // бюджет одного шарда в байтах
+    static const uint64_t check_seed = 0x27D4EB2F165667C5; // зерно второго хеша
+    static int64_t entry_bytes(const GIA_TgaImage &image); // сколько байтов бюджета занимает изображение
+public:
+    explicit GIA_TgaCache(int64_t budget_bytes, int shard_count = 16);
+    GIA_TgaCache(const GIA_TgaCache&) = delete;
+    GIA_TgaCache& operator=(const GIA_TgaCache&) = delete;
+
+    shared_ptr<const GIA_TgaImage> get(uint8_t *object_ptr, int64_t object_size, GIA_TgaErr *err = nullptr); // находит изображение в кэше либо декодирует и кладёт в кэш
+    void clear(); // удаляет все изображения (уже выданные остаются жить у потребителей)
+    int64_t used_bytes(); // занятый объём по всем шардам
+    static shared_ptr<const GIA_TgaImage> decode_image(uint8_t *object_ptr, int64_t object_size, GIA_TgaErr *err = nullptr); // декодирует объект в изображение без участия кэша (как при промахе)
+    static uint64_t content_hash(const uint8_t *data, int64_t size, uint64_t seed = 0); // 64-битный хеш содержимого (алгоритм XXH64)
+};
+
+using GIA_TgaLoadDone = std::function<void(size_t file_idx, GIA_TgaErr result, shared_ptr<const GIA_TgaImage> image)>; // итог по одному файлу; вызывается из рабочих потоков, одновременно для разных файлов
+
+// пакетная загрузка множества файлов : чтение через io_uring (Linux) либо пулом потоков с pread, декодирование по мере прихода байтов
+class GIA_TgaBulkLoader
+{
+    struct load_job // прочитанный файл, ожидающий декодирования
+    {
+        size_t file_idx;
+        GIA_TgaErr read_result; // Success или FileIOErr
+        vector<uint8_t> bytes;
+    };
+    int thread_count; // потоки декодирования (в запасном режиме они же читают файлы)
+    int queue_depth; // сколько чтений одновременно стоит в очереди io_uring
+    bool uring_enabled = true;
+    bool uring_used = false;
+    GIA_TgaCache *cache; // если задан, изображения берутся через кэш
+
+    void finish_job(load_job &job, const GIA_TgaLoadDone &done); // декодирует прочитанный файл и сообщает итог
+    bool load_uring(const vector<string> &paths, const GIA_TgaLoadDone &done); // false - io_uring недоступен, ни один файл не тронут
+    void load_pread(const vector<string> &paths, const GIA_TgaLoadDone &done);
+    static GIA_TgaErr read_file(const string &path, vector<uint8_t> &bytes);
+public:
+    explicit GIA_TgaBulkLoader(int threads = 0, int depth = 64, GIA_TgaCache *image_cache = nullptr); // threads = 0 - по числу ядер
+    GIA_TgaBulkLoader(const GIA_TgaBulkLoader&) = delete;
+    GIA_TgaBulkLoader& operator=(const GIA_TgaBulkLoader&) = delete;
+
+    void load(const vector<string> &paths, GIA_TgaLoadDone done); // возвращается, когда done вызван для каждого файла
+    void set_io_uring(bool enable); // false - всегда пул потоков с pread
+    bool io_uring_used(); // шла ли последняя загрузка через io_uring
+};
+
+// построитель пака .tgapak : объекты дописываются в файл по мере добавления, индекс с готовыми заголовками - в finish
+class GIA_TgaPackBuilder
+{
+    ofstream pack_file;
+    vector<GIA_TgaPackEntry> entries;
+    vector<string> names;
+    uint64_t write_pos = 0; // текущий конец файла пака
+    bool is_open = false;
+public:
+    GIA_TgaPackBuilder() = default;
+    GIA_TgaPackBuilder(const GIA_TgaPackBuilder&) = delete;
+    GIA_TgaPackBuilder& operator=(const GIA_TgaPackBuilder&) = delete;
+
+    GIA_TgaErr begin(const string &pack_path); // создаёт файл пака
+    GIA_TgaErr add(const string &name, uint8_t *object_ptr, int64_t object_size); // проверяет заголовок объекта и дописывает объект в пак
+    GIA_TgaErr add_file(const string &path, const string &name = string()); // читает файл и добавляет под именем name (по умолчанию - path)
+    GIA_TgaErr finish(); // дописывает индекс, отсортированный по именам, и закрывает файл
+    size_t count(); // сколько объектов добавлено
+};
+
+// пак .tgapak для чтения : весь файл отображается в память одним mmap, объекты декодируются без открытия файлов и разбора заголовков
+class GIA_TgaPack
+{
+    uint8_t *pack_ptr = nullptr;
+    int64_t pack_size = 0;
+    bool is_mapped = false; // false - пак прочитан в pack_bytes (системы без mmap)
+    vector<uint8_t> pack_bytes;
+    const GIA_TgaPackEntry *index = nullptr;
+    size_t entry_count = 0;
+    const char *names = nullptr; // таблица имён
+public:
+    GIA_TgaPack() = default;
+    ~GIA_TgaPack();
+    GIA_TgaPack(const GIA_TgaPack&) = delete;
+    GIA_TgaPack& operator=(const GIA_TgaPack&) = delete;
+
+    GIA_TgaErr open(const string &pack_path); // отображает пак и проверяет индекс
+    void close();
+    size_t count(); // количество объектов в паке
+    int64_t find(const string &name); // номер записи по имени (двоичный поиск) либо -1
+    string name(size_t entry_idx); // имя записи
+    const GIA_TgaPackEntry* entry(size_t entry_idx); // запись индекса (nullptr вне диапазона)
+    uint8_t* object(size_t entry_idx); // начало объекта внутри отображения (nullptr вне диапазона)
+    GIA_TgaErr init_decoder(GIA_TgaDecoder &decoder, size_t entry_idx); // init декодера объектом записи с готовым заголовком
+};
+
+struct GIA_TgaDiskCacheHeader // заголовок файла дискового кэша; за ним сразу пиксели BB GG RR AA (все поля little-endian)
+{
+    char     magic[8]; // "GIATDC1\0"
+    uint64_t key; // ключ : путь, время изменения и хеш содержимого исходного файла
+    uint32_t width;
+    uint32_t height;
+    uint64_t bytes_per_line;
+    uint32_t result; // итог decode (GIA_TgaErr)
+    uint8_t  reserved[28]; // до 64 байтов, чтобы пиксели в отображении были выровнены
+};
+
+struct GIA_TgaMappedImage // изображение из дискового кэша
+{
+    int width;
+    int height;
+    int64_t bytes_per_line;
+    GIA_TgaErr result; // итог decode : Success, TruncDataAbort, TooMuchPixAbort либо ошибка загрузки (тогда data пуст)
+    shared_ptr<const uint8_t> data; // пиксели BB GG RR AA, уже приведённые к TopLeft; отображение файла живёт, пока жив указатель
+};
+
+// кэш декодированных изображений в каталоге на диске : при попадании файл кэша отображается в память только для чтения
+class GIA_TgaDiskCache
+{
+    string cache_dir;
+    int64_t budget_bytes; // предел суммарного размера файлов кэша
+    atomic<int64_t> used_estimate; // оценка занятого места (каталог могут делить несколько процессов, trim пересчитывает)
+    mutex trim_lock;
+    string entry_path(uint64_t key); // путь файла кэша по ключу
+    static GIA_TgaMappedImage map_entry(const string &path, uint64_t key); // отображает файл кэша; result = FileIOErr, если файла нет или он не подходит
+public:
+    GIA_TgaDiskCache(const string &directory, int64_t max_bytes); // каталог создаётся при необходимости
+    GIA_TgaDiskCache(const GIA_TgaDiskCache&) = delete;
+    GIA_TgaDiskCache& operator=(const GIA_TgaDiskCache&) = delete;
+
+    GIA_TgaMappedImage load(const string &path); // берёт изображение из кэша либо декодирует файл и кладёт результат в кэш
+    void trim(); // удаляет давно неиспользованные файлы кэша, пока занятое место больше предела
+    void clear(); // удаляет все файлы кэша (уже отображённые изображения остаются доступны)
+    int64_t used_bytes(); // суммарный размер файлов кэша в каталоге
 };
 
 }